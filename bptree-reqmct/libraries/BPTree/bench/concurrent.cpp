@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "BPTree.hpp"
+#include "BPTreeConcurrent.hpp"
+
+namespace {
+
+const long long key_space = 10000000;
+
+// the tree used until now: a BPTree behind one global mutex
+struct LockedTree {
+    BPTree<long long, long long> tree;
+    std::mutex mutex;
+
+    void insert(const long long key, const long long value) {
+        std::lock_guard<std::mutex> guard(mutex);
+        tree.insert(key, value);
+    }
+
+    bool contains(const long long key) {
+        std::lock_guard<std::mutex> guard(mutex);
+        return tree.contains(key);
+    }
+};
+
+struct OptimisticTree {
+    ConcurrentBPTree<long long, long long> tree;
+
+    void insert(const long long key, const long long value) { tree.insert(key, value); }
+
+    bool contains(const long long key) { return tree.contains(key); }
+};
+
+// every thread does 'operations' lookups and inserts of random keys, 'write_percent' of them inserts
+template <class Tree>
+double throughput(const std::size_t threads, const int write_percent, const std::size_t operations) {
+    Tree tree;
+    std::atomic<std::size_t> hits{0};
+    for (long long key = 0; key < key_space; key += 10) {
+        tree.insert(key, key);
+    }
+    std::vector<std::thread> workers;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&tree, &hits, t, write_percent, operations] {
+            std::mt19937_64 gen(t);
+            std::size_t found = 0;
+            for (std::size_t i = 0; i < operations; ++i) {
+                const long long key = static_cast<long long>(gen() % key_space);
+                if (static_cast<int>(gen() % 100) < write_percent) {
+                    tree.insert(key, key);
+                } else {
+                    found += tree.contains(key);
+                }
+            }
+            hits += found;
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(threads * operations) / seconds / 1e6;
+}
+
+}  // anonymous namespace
+
+int main() {
+    const std::size_t cores      = std::max(std::thread::hardware_concurrency(), 1u);
+    const std::size_t operations = 1000000;
+    std::cout << cores << " hardware threads, Mops/s\n";
+    for (const int write_percent : {0, 10, 50}) {
+        std::cout << write_percent << "% inserts\n";
+        std::cout << std::setw(10) << "threads" << std::setw(14) << "global mutex" << std::setw(14) << "optimistic"
+                  << '\n';
+        for (std::size_t threads = 1; threads <= std::max<std::size_t>(cores, 4); threads *= 2) {
+            std::cout << std::setw(10) << threads << std::fixed << std::setprecision(2) << std::setw(14)
+                      << throughput<LockedTree>(threads, write_percent, operations) << std::setw(14)
+                      << throughput<OptimisticTree>(threads, write_percent, operations) << '\n';
+        }
+    }
+}
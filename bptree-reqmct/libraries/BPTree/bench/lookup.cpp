@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BPTree.hpp"
+
+namespace {
+
+std::mt19937_64 gen{20231017};
+
+template <class Key>
+struct KeyFactory {
+    static Key create(const int x) { return x; }
+};
+
+template <>
+struct KeyFactory<std::string> {
+    static std::string create(const int x) {
+        std::ostringstream ss;
+        ss << "key-" << std::setw(12) << std::setfill('0') << x;
+        return ss.str();
+    }
+};
+
+template <class Tree, class Key>
+void report(const char *name, const Tree &tree, const std::vector<Key> &keys) {
+    std::size_t found = 0;
+    const auto start  = std::chrono::steady_clock::now();
+    for (const auto &key : keys) {
+        found += tree.find(key) != tree.end();
+    }
+    const auto finish = std::chrono::steady_clock::now();
+    const double ns   = std::chrono::duration<double, std::nano>(finish - start).count() / keys.size();
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(10) << tree.size() << " keys "
+              << std::fixed << std::setprecision(1) << std::setw(8) << ns << " ns/op (hits: " << found << ")\n";
+}
+
+template <class Tree, class Key>
+void report_many(const char *name, const Tree &tree, const std::vector<Key> &keys, const std::size_t batch) {
+    std::vector<typename Tree::const_iterator> results(keys.size());
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < keys.size(); i += batch) {
+        const std::size_t size = std::min(batch, keys.size() - i);
+        tree.find_many(keys.begin() + i, keys.begin() + i + size, results.begin() + i);
+    }
+    const auto finish = std::chrono::steady_clock::now();
+    const double ns   = std::chrono::duration<double, std::nano>(finish - start).count() / keys.size();
+    std::size_t found = 0;
+    for (const auto &result : results) {
+        found += result != tree.end();
+    }
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(10) << tree.size() << " keys "
+              << std::fixed << std::setprecision(1) << std::setw(8) << ns << " ns/op (hits: " << found << ")\n";
+}
+
+template <class Key, class Search = bptree::DefaultSearch<Key, std::less<Key>>>
+void lookup(const char *name, const int count, const int queries, const bool variants = false) {
+    BPTree<Key, int, 4096, std::less<Key>, Search> tree;
+    std::vector<int> order(count);
+    for (int i = 0; i < count; ++i) {
+        order[i] = 2 * i;
+    }
+    std::shuffle(order.begin(), order.end(), gen);
+    for (const int x : order) {
+        tree.insert(KeyFactory<Key>::create(x), x);
+    }
+
+    std::uniform_int_distribution<int> dist(0, 2 * count);
+    std::vector<Key> keys;
+    keys.reserve(queries);
+    for (int i = 0; i < queries; ++i) {
+        keys.push_back(KeyFactory<Key>::create(dist(gen)));
+    }
+
+    report(name, tree, keys);
+    if (variants) {
+        report("  frozen", tree.freeze(), keys);
+        report_many("  find_many, 1000 per batch", tree, keys, 1000);
+    }
+}
+
+}  // anonymous namespace
+
+int main() {
+    lookup<int>("find BPTree<int, int>", 1000000, 2000000, true);
+    lookup<int, bptree::LinearSearch>("  linear in-node search", 1000000, 2000000);
+    lookup<int, bptree::BinarySearch>("  binary in-node search", 1000000, 2000000);
+    lookup<int, bptree::SimdSearch>("  simd in-node search", 1000000, 2000000);
+    lookup<std::string>("find BPTree<string, int>", 200000, 500000, true);
+    lookup<std::string, bptree::LinearSearch>("  linear in-node search", 200000, 500000);
+}
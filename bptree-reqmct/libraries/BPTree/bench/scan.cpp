@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "BPTree.hpp"
+
+namespace {
+
+std::mt19937_64 gen{20231017};
+
+using Tree = BPTree<long long, long long>;
+
+template <class Scan>
+void measure(const char *name, const Tree &tree, const int rounds, Scan scan) {
+    long long sum    = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        sum += scan();
+    }
+    const auto finish   = std::chrono::steady_clock::now();
+    const double ns     = std::chrono::duration<double, std::nano>(finish - start).count();
+    const double values = static_cast<double>(tree.size()) * rounds;
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(8) << ns / values << " ns/element " << std::setw(8)
+              << values * sizeof(Tree::value_type) / ns << " GB/s (sum: " << sum << ")\n";
+}
+
+void scan(const char *name, const Tree &tree, const int rounds) {
+    std::cout << name << ", " << tree.size() << " elements\n";
+    const long long lo = 0, hi = static_cast<long long>(tree.size());
+    measure("  iterator loop", tree, rounds, [&] {
+        long long sum = 0;
+        for (auto it = tree.lower_bound(lo), last = tree.lower_bound(hi); it != last; ++it) {
+            sum += it->second;
+        }
+        return sum;
+    });
+    measure("  scan", tree, rounds, [&] {
+        long long sum = 0;
+        tree.scan(lo, hi, [&sum](const Tree::value_type &element) { sum += element.second; });
+        return sum;
+    });
+    measure("  scan_chunks", tree, rounds, [&] {
+        long long sum = 0;
+        tree.scan_chunks(lo, hi, [&sum](const Tree::value_type *first, const Tree::value_type *last) {
+            for (; first != last; ++first) {
+                sum += first->second;
+            }
+        });
+        return sum;
+    });
+}
+
+}  // anonymous namespace
+
+int main() {
+    const int count = 10000000;
+    std::vector<std::pair<long long, long long>> data(count);
+    for (int i = 0; i < count; ++i) {
+        data[i] = {i, i};
+    }
+    scan("bulk loaded tree", Tree::from_sorted(data.begin(), data.end()), 10);
+
+    std::shuffle(data.begin(), data.end(), gen);
+    Tree shuffled;
+    for (const auto &[key, value] : data) {
+        shuffled.insert(key, value);
+    }
+    scan("tree built by random inserts", shuffled, 10);
+}
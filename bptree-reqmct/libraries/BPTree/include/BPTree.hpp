@@ -1,800 +1,2796 @@
 #ifndef BPTREE_HPP
 #define BPTREE_HPP
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <future>
 #include <iostream>
-#include <queue>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-template <class Key, class Value, std::size_t BlockSize = 4096, class Less = std::less<Key>>
-class BPTree {
-    static const std::size_t max_size =
-        (BlockSize - sizeof(std::size_t) - sizeof(void *)) / (sizeof(Key) + sizeof(void *));
+#include "BPTreeAggregate.hpp"
+#include "BPTreeAllocator.hpp"
+#include "BPTreeFrozen.hpp"
+#include "BPTreeImage.hpp"
+#include "BPTreeSearch.hpp"
 
-    static const std::size_t neutral = std::size_t(-1);
+template <class Key, class Value, std::size_t BlockSize = 4096, class Less = std::less<Key>,
+          class Search = bptree::DefaultSearch<Key, Less>,
+          template <std::size_t Size, std::size_t Align> class Allocator = bptree::Arena, bool OrderStatistics = false,
+          class Aggregate = bptree::NoAggregate>
+class BPTree {
+    struct InternalNode;
+    struct LeafNode;
 
+    // nodes keep no parent pointers: insert and erase record the path from the root on the way down
     struct Node {
-        using key_type    = Key;
-        using mapped_type = Value;
-        using value_type  = std::pair<Key, Value>;
-        using node_type   = Node;
-        bool is_leaf;
-        std::vector<value_type> keys;
         std::size_t size;
-        node_type *parent = nullptr;
-        std::vector<node_type *> children;
-        static bool check(const Key &first, const Key &second, const std::string &operation) {
-            if (operation == "==") {
-                return Less{}(first, second) == Less{}(second, first);
+        bool is_leaf;
+    };
+
+    static constexpr std::size_t min_size = 2;
+
+    static constexpr std::size_t fit(const std::size_t reserved, const std::size_t slot) {
+        return std::max(BlockSize > reserved ? (BlockSize - reserved) / slot : 0, min_size);
+    }
+
+    template <class T>
+    static constexpr std::size_t align_slack() {
+        return alignof(T) > alignof(void *) ? alignof(T) : 0;
+    }
+
+    using aggregate_type = typename Aggregate::type;
+
+    static constexpr bool aggregated = !std::is_same_v<Aggregate, bptree::NoAggregate>;
+    static constexpr bool summarized = OrderStatistics || aggregated;
+
+    // with order statistics every child of an internal node comes with the number of elements under it, with an
+    // aggregate policy it comes with the aggregate of the values under it
+    static constexpr std::size_t summary_bytes =
+        (OrderStatistics ? sizeof(std::size_t) : 0) + (aggregated ? sizeof(aggregate_type) : 0);
+
+    template <class T>
+    struct StringKey: std::false_type {};
+
+    template <class Char, class Traits, class Alloc>
+    struct StringKey<std::basic_string<Char, Traits, Alloc>>: std::true_type {};
+
+    // strings in their natural order get suffix-truncated separators, see separator()
+    static constexpr bool truncated = StringKey<Key>::value && bptree::detail::natural_order<Less, Key>;
+
+    // truncated separators are packed into a character area of the node with an offset each (see NodeKeys) instead
+    // of taking a whole Key, so the node is sized for separators of separator_bytes on average and holds fewer of
+    // them only when they are longer
+    static constexpr std::size_t separator_bytes = 8;
+    static constexpr std::size_t key_bytes       = truncated ? sizeof(std::uint32_t) + separator_bytes : sizeof(Key);
+    static constexpr std::size_t keys_reserved   = truncated ? 2 * sizeof(void *) + 3 * sizeof(std::uint32_t) : 0;
+
+    // internal nodes hold K keys and K + 1 children, leaves hold key-value pairs and links to both neighbours
+    static constexpr std::size_t internal_size =
+        fit(sizeof(Node) + sizeof(void *) + summary_bytes + keys_reserved + align_slack<Key>() +
+                align_slack<aggregate_type>(),
+            key_bytes + sizeof(void *) + summary_bytes);
+    static constexpr std::size_t leaf_size =
+        fit(sizeof(Node) + 2 * sizeof(void *) + align_slack<std::pair<Key, Value>>(), sizeof(std::pair<Key, Value>));
+
+    static constexpr std::size_t internal_min = internal_size / 2;
+    static constexpr std::size_t leaf_min     = leaf_size / 2;
+
+    static const std::size_t neutral = std::size_t(-1);
+
+    enum class Compare { equal, less, greater, less_equal, greater_equal };
+
+    // the comparison is picked at compile time, so every check is a single call of Less (two for 'equal'); either
+    // side may be a lookup key of another type when Less is transparent
+    template <Compare operation, class First, class Second>
+    static bool check(const First &first, const Second &second) {
+        if constexpr (operation == Compare::equal) {
+            return !Less{}(first, second) && !Less{}(second, first);
+        } else if constexpr (operation == Compare::less) {
+            return Less{}(first, second);
+        } else if constexpr (operation == Compare::greater) {
+            return Less{}(second, first);
+        } else if constexpr (operation == Compare::less_equal) {
+            return !Less{}(second, first);
+        } else {
+            return !Less{}(first, second);
+        }
+    }
+
+    struct SlotKey {
+        const Key &operator()(const std::pair<Key, Value> &slot) const { return slot.first; }
+    };
+
+    template <class L, class = void>
+    struct Transparent: std::false_type {};
+
+    template <class L>
+    struct Transparent<L, std::void_t<typename L::is_transparent>>: std::true_type {};
+
+    // the lookup overloads taking a 'K' exist only for a Less that declares is_transparent, as std::less<> does
+    template <class K>
+    using transparent_t = std::enable_if_t<Transparent<Less>::value, K>;
+
+    template <std::size_t Count, bool = OrderStatistics>
+    struct ChildCounts {
+        std::size_t counts[Count];
+    };
+
+    template <std::size_t Count>
+    struct ChildCounts<Count, false> {};
+
+    template <std::size_t Count, bool = aggregated>
+    struct ChildAggregates {
+        aggregate_type aggregates[Count];
+    };
+
+    template <std::size_t Count>
+    struct ChildAggregates<Count, false> {};
+
+    // the separators of an internal node. Truncated strings are never handed out through iterators, so they need not
+    // be strings of their own: the prefix all of them share is kept once at the start of a character area inside the
+    // node and the rest of each of them follows in order, from offsets[i] to offsets[i + 1] for the separator i. A
+    // search compares the key with the shared prefix once and then only with the suffixes packed next to each other,
+    // with no pointer to follow per separator. The node splits, borrows and merges by the characters as well (see
+    // InternalNode), so the area overflows only in corner cases, such as a single separator longer than half of it;
+    // the separators then move to the heap as a whole until enough of them are gone. Any other keys are kept in a
+    // plain array
+    template <std::size_t Count, bool = truncated>
+    struct NodeKeys {
+        using Char   = typename Key::value_type;
+        using Traits = typename Key::traits_type;
+        using View   = std::basic_string_view<Char, Traits>;
+
+        // a separator given as two consecutive parts, so that one is moved between nodes without building a Key
+        struct Parts {
+            View head;
+            View tail;
+
+            std::size_t size() const { return head.size() + tail.size(); }
+
+            Char operator[](const std::size_t ind) const {
+                return ind < head.size() ? head[ind] : tail[ind - head.size()];
             }
-            if (operation == "<") {
-                return Less{}(first, second);
+
+            // copies the characters [from, to) to 'target'
+            void copy(std::size_t from, const std::size_t to, Char *target) const {
+                if (from < head.size()) {
+                    const std::size_t count = std::min(to, head.size()) - from;
+                    Traits::copy(target, head.data() + from, count);
+                    target += count;
+                    from += count;
+                }
+                if (from < to) {
+                    Traits::copy(target, tail.data() + (from - head.size()), to - from);
+                }
             }
-            if (operation == ">") {
-                return Less{}(second, first);
+        };
+
+        // the search runs over the indices [0, size), the projections turn the index of a separator into its suffix
+        struct Indices {
+            std::uint32_t values[Count];
+
+            constexpr Indices(): values() {
+                for (std::size_t i = 0; i < Count; i++) {
+                    values[i] = static_cast<std::uint32_t>(i);
+                }
             }
-            if (operation == "<=") {
-                return check(first, second, "==") || check(first, second, "<");
+        };
+
+        static constexpr Indices indices{};
+
+        struct Suffix {
+            const Char *data;
+            const std::uint32_t *offsets;
+
+            View operator()(const std::uint32_t ind) const {
+                return View(data + offsets[ind], offsets[ind + 1] - offsets[ind]);
             }
-            if (operation == ">=") {
-                return check(first, second, "==") || check(first, second, ">");
+        };
+
+        // a lookup key that is no string view is compared with whole separators, which are put together in 'probe'
+        // behind the shared prefix, so that it allocates at most a few times per search
+        struct Whole {
+            const NodeKeys *keys;
+            Key *probe;
+
+            const Key &operator()(const std::uint32_t ind) const {
+                const View suffix = keys->whole(ind).tail;
+                probe->replace(keys->prefix, Key::npos, suffix.data(), suffix.size());
+                return *probe;
             }
-            return false;
-        }
+        };
 
-        void clear() {
-            is_leaf = true;
-            delete this;
+        static constexpr std::size_t inline_size = Count * separator_bytes / sizeof(Char);
+
+        Char *spilled              = nullptr;
+        std::uint32_t spilled_size = 0;
+        std::uint32_t prefix       = 0;
+        std::uint32_t offsets[Count + 1];
+        Char area[inline_size];
+
+        NodeKeys() { offsets[0] = 0; }
+
+        NodeKeys(const NodeKeys &) = delete;
+
+        NodeKeys &operator=(const NodeKeys &) = delete;
+
+        ~NodeKeys() { delete[] spilled; }
+
+        const Char *bytes() const { return spilled != nullptr ? spilled : area; }
+
+        Char *bytes() { return spilled != nullptr ? spilled : area; }
+
+        View shared() const { return View(bytes(), prefix); }
+
+        Parts whole(const std::size_t ind) const {
+            return {shared(), View(bytes() + offsets[ind], offsets[ind + 1] - offsets[ind])};
         }
 
-        Node(const Node &node) {
-            is_leaf = node.is_leaf;
-            size    = node.size;
-            keys.clear();
-            keys.resize(max_size + 1);
-            children.clear();
-            children.resize(max_size + 2, nullptr);
-            for (std::size_t i = 0; i < size; i++) {
-                keys[i] = value_type(node.keys[i].first, node.keys[i].second);
-            }
-            if (this->is_leaf) {
-                return;
-            }
-            for (std::size_t i = 0; i <= size; i++) {
-                children[i]         = new Node(*node.children[i]);
-                children[i]->parent = this;
+        static std::size_t common(const Parts &a, const Parts &b) {
+            const std::size_t length = std::min(a.size(), b.size());
+            std::size_t ind          = 0;
+            while (ind < length && Traits::eq(a[ind], b[ind])) {
+                ind++;
             }
+            return ind;
         }
 
-        Node &operator=(const Node &source) { return *new (this) Node(source); }
+        // the sign of the comparison of the separator 'ind' with 'key'
+        int compare(const std::size_t ind, const View key) const {
+            const int order = shared().compare(key.substr(0, prefix));
+            return order != 0 ? order : whole(ind).tail.compare(key.substr(prefix));
+        }
 
-        ~Node() {
-            parent = nullptr;
-            if (!is_leaf) {
-                for (std::size_t i = 0; i <= size; i++) {
-                    delete children[i];
+        template <class K>
+        std::size_t lower_bound(const std::size_t size, const K &find) const {
+            if constexpr (std::is_convertible_v<const K &, View>) {
+                const View key  = find;
+                const int order = shared().compare(key.substr(0, prefix));
+                if (order != 0) {
+                    return order > 0 ? 0 : size;
                 }
+                return Search::template lower_bound<std::less<>>(indices.values, size, key.substr(prefix),
+                                                                 Suffix{bytes(), offsets});
+            } else {
+                Key probe(shared());
+                return Search::template lower_bound<Less>(indices.values, size, find, Whole{this, &probe});
             }
         }
 
-        Node() {
-            is_leaf = false;
-            keys.clear();
-            keys.resize(max_size + 1);
-            size   = 0;
-            parent = nullptr;
-            children.clear();
-            children.resize(max_size + 2, nullptr);
-        }
-
-        std::size_t getIndex(const Key &find) {
-            for (std::size_t i = 0; i < size; i++) {
-                if (check(find, keys[i].first, "==")) {
-                    return i;
+        template <Compare operation, class K>
+        bool check_key(const std::size_t ind, const K &key) const {
+            if constexpr (std::is_convertible_v<const K &, View>) {
+                const int order = compare(ind, key);
+                if constexpr (operation == Compare::equal) {
+                    return order == 0;
+                } else if constexpr (operation == Compare::less) {
+                    return order < 0;
+                } else if constexpr (operation == Compare::greater) {
+                    return order > 0;
+                } else if constexpr (operation == Compare::less_equal) {
+                    return order <= 0;
+                } else {
+                    return order >= 0;
                 }
+            } else {
+                return check<operation>(take(ind), key);
             }
-            return neutral;
         }
 
-        std::size_t getChildIndex(const Key &find) {
-            if (size == 0 || check(find, keys[0].first, "<=")) {
-                return 0;
+        Key take(const std::size_t ind) const {
+            const Parts parts = whole(ind);
+            Key key(parts.head);
+            key.append(parts.tail);
+            return key;
+        }
+
+        // the length of the separators [0, size) taken whole
+        std::size_t characters(const std::size_t size) const { return size * prefix + offsets[size] - prefix; }
+
+        // the characters counted against the area for 'count' separators of 'total' characters in all that share a
+        // prefix of 'length'. A prefix longer than half of the area counts as half, since splitting the node would
+        // not make it any shorter; such a node keeps its separators on the heap
+        static std::size_t charge(const std::size_t total, const std::size_t count, const std::size_t length) {
+            return count > 0 ? std::min(length, inline_size / 2) + total - count * length : 0;
+        }
+
+        std::size_t charged(const std::size_t size) const { return charge(characters(size), size, prefix); }
+
+        // whether 'key' fits into the area next to the 'size' separators, with the prefix they would share then
+        bool fits(const std::size_t size, const Parts &key) const {
+            const std::size_t length = size > 0 ? common({shared(), View()}, key) : key.size();
+            return charge(characters(size) + key.size(), size + 1, length) <= inline_size;
+        }
+
+        // the characters the 'size' separators here, 'middle' and the 'count' ones of 'next' take in a single node
+        std::size_t joined(const std::size_t size, const Parts &middle, const NodeKeys &next,
+                           const std::size_t count) const {
+            std::size_t length = common(size > 0 ? whole(0) : middle, count > 0 ? next.whole(count - 1) : middle);
+            if (size > 0) {
+                length = std::min<std::size_t>(length, prefix);
             }
-            for (std::size_t i = 1; i < size; i++) {
-                if (check(keys[i - 1].first, find, "<") && check(find, keys[i].first, "<=")) {
-                    return i;
-                }
+            return charge(characters(size) + middle.size() + next.characters(count), size + 1 + count, length);
+        }
+
+        // makes room for 'needed' characters, moving the 'used' ones to a larger heap area if the node has too few
+        void reserve(const std::size_t used, const std::size_t needed) {
+            const std::size_t capacity = spilled != nullptr ? spilled_size : inline_size;
+            if (needed <= capacity) {
+                return;
             }
-            return size;
+            const std::size_t grown = std::max(needed, 2 * capacity);
+            Char *heap              = new Char[grown];
+            Traits::copy(heap, bytes(), used);
+            delete[] spilled;
+            spilled      = heap;
+            spilled_size = static_cast<std::uint32_t>(grown);
         }
 
-        std::size_t getChildrenByNode(Node *node) {
-            for (std::size_t i = 0; i <= size; i++) {
-                if (children[i] == node) {
-                    return i;
-                }
+        // goes back to the inline area once the separators take no more than half of it
+        void settle(const std::size_t used) {
+            if (spilled != nullptr && used <= inline_size / 2) {
+                Traits::copy(area, spilled, used);
+                delete[] spilled;
+                spilled = nullptr;
             }
-            return neutral;
         }
 
-        template <class forward_type>
-        bool add_element(const Key &key, forward_type &&value, node_type *child1, node_type *child2) {
-            if (child1 != nullptr) {
-                child1->parent = this;
+        // keeps only 'length' characters of the shared prefix, the rest of it goes to the front of every suffix.
+        // Every suffix but the first moves to the right, so they are moved from the last one; the first one is
+        // preceded by the characters it gets already
+        void shorten(const std::size_t size, const std::size_t length) {
+            const std::size_t moved = prefix - length;
+            reserve(offsets[size], offsets[size] + (size - 1) * moved);
+            Char *data = bytes();
+            for (std::size_t i = size; i-- > 1;) {
+                const std::size_t target = offsets[i] + (i - 1) * moved;
+                Traits::move(data + target + moved, data + offsets[i], offsets[i + 1] - offsets[i]);
+                Traits::copy(data + target, data + length, moved);
             }
-            if (child2 != nullptr) {
-                child2->parent = this;
+            for (std::size_t i = 1; i <= size; i++) {
+                offsets[i] += static_cast<std::uint32_t>((i - 1) * moved);
             }
+            offsets[0] = prefix = static_cast<std::uint32_t>(length);
+        }
+
+        // starts an empty node with the first 'length' characters of 'key' as the shared prefix
+        void start(const Parts &key, const std::size_t length) {
+            settle(0);
+            reserve(0, length);
+            key.copy(0, length, bytes());
+            offsets[0] = prefix = static_cast<std::uint32_t>(length);
+        }
+
+        void insert(const std::size_t size, const std::size_t ind, const Parts &key) {
             if (size == 0) {
-                if (!is_leaf) {
-                    children[0] = child1;
-                    children[1] = child2;
-                } else {
-                    if (children[0] != nullptr) {
-                        children[0]->children[1] = this;
-                    }
-                    if (children[1] != nullptr) {
-                        children[1]->children[0] = this;
-                    }
+                start(key, key.size());
+            } else {
+                const std::size_t length = common({shared(), View()}, key);
+                if (length < prefix) {
+                    shorten(size, length);
                 }
-                keys[0] = value_type(key, std::forward<forward_type>(value));
-                size++;
-                return true;
-            }
-            std::size_t ind = getIndex(key);
-            if (ind != neutral) {
-                keys[ind] = value_type(key, std::forward<forward_type>(value));
-                return false;
-            }
-            ind = getChildIndex(key);
-            for (std::size_t i = size; i > ind; i--) {
-                std::swap(keys[i], keys[i - 1]);
-            }
-            keys[ind] = value_type(key, std::forward<forward_type>(value));
-            size++;
-            if (is_leaf) {
-                return true;
             }
-            for (std::size_t i = size; i > ind; i--) {
-                children[i] = children[i - 1];
+            const std::size_t added = key.size() - prefix;
+            const std::size_t used  = offsets[size];
+            reserve(used, used + added);
+            Char *data = bytes();
+            Traits::move(data + offsets[ind] + added, data + offsets[ind], used - offsets[ind]);
+            key.copy(prefix, key.size(), data + offsets[ind]);
+            for (std::size_t i = size + 1; i > ind; i--) {
+                offsets[i] = offsets[i - 1] + static_cast<std::uint32_t>(added);
             }
-            children[ind]     = child1;
-            children[ind + 1] = child2;
-            return true;
         }
 
-        void delete_by_ind(int ind) {
-            for (std::size_t i = ind; i < size - 1; i++) {
-                std::swap(keys[i], keys[i + 1]);
+        void insert(const std::size_t size, const std::size_t ind, const Key &key) {
+            insert(size, ind, Parts{View(key), View()});
+        }
+
+        void assign(const std::size_t size, const std::size_t ind, const Key &key) {
+            erase(size, ind, 1);
+            insert(size - 1, ind, key);
+        }
+
+        void erase(const std::size_t size, const std::size_t from, const std::size_t count) {
+            const std::size_t removed = offsets[from + count] - offsets[from];
+            Char *data                = bytes();
+            Traits::move(data + offsets[from], data + offsets[from + count], offsets[size] - offsets[from + count]);
+            for (std::size_t i = from; i + count <= size; i++) {
+                offsets[i] = offsets[i + count] - static_cast<std::uint32_t>(removed);
             }
-            if (!is_leaf) {
-                for (std::size_t i = ind; i < size; i++) {
-                    std::swap(children[i], children[i + 1]);
-                }
-                children[size] = nullptr;
+            settle(offsets[size - count]);
+        }
+
+        // keeps the separators [0, keep), which may have a longer prefix in common than all of them had
+        void truncate(const std::size_t, const std::size_t keep) {
+            if (keep > 0) {
+                tighten(keep);
             }
-            size--;
+            settle(offsets[keep]);
         }
 
-        void merge_leaf(Node *prev) {
-            children[0] = prev->children[0];
-            if (children[0] != nullptr) {
-                children[0]->children[1] = this;
+        // moves what the 'size' separators have in common beyond the shared prefix into it. The first suffix starts
+        // with the characters the prefix gets already, so only the other suffixes move, each to the left
+        void tighten(const std::size_t size) {
+            const std::size_t extra = common(whole(0), whole(size - 1)) - prefix;
+            if (extra == 0) {
+                return;
             }
-            if (size >= 1) {
-                for (std::size_t i = size - 1;; i--) {
-                    keys[i + prev->size] = keys[i];
-                    if (i == 0) {
-                        break;
-                    }
-                }
+            Char *data = bytes();
+            for (std::size_t i = 1; i < size; i++) {
+                Traits::move(data + offsets[i] - (i - 1) * extra, data + offsets[i] + extra,
+                             offsets[i + 1] - offsets[i] - extra);
             }
-            for (std::size_t i = 0; i < prev->size; i++) {
-                keys[i] = prev->keys[i];
+            for (std::size_t i = 1; i <= size; i++) {
+                offsets[i] -= static_cast<std::uint32_t>((i - 1) * extra);
             }
-            size += prev->size;
+            offsets[0] = prefix = static_cast<std::uint32_t>(prefix + extra);
         }
 
-        void merge(Node *prev, value_type element) {
-            if (is_leaf) {
-                merge_leaf(prev);
+        // appends the separators [from, to) of 'source', which come after every one here; the prefix they all
+        // share is that of the first and the last of them
+        void append(const std::size_t size, const NodeKeys &source, const std::size_t from, const std::size_t to) {
+            if (from == to) {
                 return;
             }
-            if (size >= 1) {
-                for (std::size_t i = size - 1;; i--) {
-                    keys[i + prev->size + 1] = keys[i];
-                    if (i == 0) {
-                        break;
-                    }
-                }
+            const Parts first        = size > 0 ? whole(0) : source.whole(from);
+            const std::size_t length = common(first, source.whole(to - 1));
+            if (size == 0) {
+                start(first, length);
+            } else if (length < prefix) {
+                shorten(size, length);
             }
-            for (std::size_t i = 0; i < prev->size; i++) {
-                keys[i] = prev->keys[i];
+            std::size_t added = 0;
+            for (std::size_t i = from; i < to; i++) {
+                added += source.whole(i).size() - prefix;
             }
-            keys[prev->size] = element;
-            for (std::size_t i = size;; i--) {
-                children[i + prev->size + 1] = children[i];
-                if (i == 0) {
-                    break;
-                }
+            reserve(offsets[size], offsets[size] + added);
+            Char *data = bytes();
+            for (std::size_t i = from; i < to; i++) {
+                const Parts key      = source.whole(i);
+                const std::size_t at = size + i - from;
+                key.copy(prefix, key.size(), data + offsets[at]);
+                offsets[at + 1] = offsets[at] + static_cast<std::uint32_t>(key.size() - prefix);
+            }
+        }
+
+        void copy(const NodeKeys &source, const std::size_t size) {
+            settle(0);
+            reserve(0, source.offsets[size]);
+            Traits::copy(bytes(), source.bytes(), source.offsets[size]);
+            std::copy(source.offsets, source.offsets + size + 1, offsets);
+            prefix = source.prefix;
+        }
+    };
+
+    template <std::size_t Count>
+    struct NodeKeys<Count, false> {
+        Key keys[Count];
+
+        template <class K>
+        std::size_t lower_bound(const std::size_t size, const K &find) const {
+            return Search::template lower_bound<Less>(keys, size, find, bptree::Identity{});
+        }
+
+        template <Compare operation, class K>
+        bool check_key(const std::size_t ind, const K &key) const {
+            return check<operation>(keys[ind], key);
+        }
+
+        Key take(const std::size_t ind) { return std::move(keys[ind]); }
+
+        template <class forward_type>
+        void insert(const std::size_t size, const std::size_t ind, forward_type &&key) {
+            for (std::size_t i = size; i > ind; i--) {
+                keys[i] = std::move(keys[i - 1]);
             }
-            for (std::size_t i = 0; i < prev->size + 1; i++) {
-                children[i]         = prev->children[i];
-                children[i]->parent = this;
+            keys[ind] = std::forward<forward_type>(key);
+        }
+
+        template <class forward_type>
+        void assign(const std::size_t, const std::size_t ind, forward_type &&key) {
+            keys[ind] = std::forward<forward_type>(key);
+        }
+
+        void erase(const std::size_t size, const std::size_t from, const std::size_t count) {
+            for (std::size_t i = from; i + count < size; i++) {
+                keys[i] = std::move(keys[i + count]);
             }
-            size = size + prev->size + 1;
         }
 
-        node_type *split_node() {
-            std::size_t size1 = size / 2 + size % 2;
-            node_type *node   = make_new_node(size1, size);
-            return node;
+        void truncate(const std::size_t, const std::size_t) {}
+
+        void append(const std::size_t size, NodeKeys &source, const std::size_t from, const std::size_t to) {
+            for (std::size_t i = from; i < to; i++) {
+                keys[size + i - from] = std::move(source.keys[i]);
+            }
         }
 
-    private:
-        node_type *make_new_node(std::size_t start, std::size_t finish) {
-            node_type *node = new node_type();
-            node->size      = finish - start;
-            this->size      = start;
-            node->is_leaf   = this->is_leaf;
-            node->parent    = this->parent;
-            for (std::size_t i = start; i < finish; i++) {
-                std::swap(node->keys[i - start], this->keys[i]);
+        void copy(const NodeKeys &source, const std::size_t size) { std::copy(source.keys, source.keys + size, keys); }
+    };
+
+    struct InternalData: Node, ChildCounts<internal_size + 1>, ChildAggregates<internal_size + 1> {
+        Node *children[internal_size + 1];
+        NodeKeys<internal_size> keys;
+    };
+
+    struct LeafData: Node {
+        LeafNode *prev;
+        LeafNode *next;
+        std::pair<Key, Value> slots[leaf_size];
+    };
+
+    template <std::size_t Bytes, bool = Bytes == 0>
+    struct BlockPadding {
+        unsigned char padding[Bytes];
+    };
+
+    template <std::size_t Bytes>
+    struct BlockPadding<Bytes, true> {};
+
+    template <class Data>
+    struct BlockSized: Data, BlockPadding<(BlockSize > sizeof(Data) ? BlockSize - sizeof(Data) : 0)> {};
+
+    struct InternalNode: BlockSized<InternalData> {
+        using InternalData::children;
+        using InternalData::keys;
+        using Node::is_leaf;
+        using Node::size;
+
+        InternalNode() {
+            size    = 0;
+            is_leaf = false;
+            std::fill(std::begin(children), std::end(children), nullptr);
+        }
+
+        template <class K>
+        std::size_t getChildIndex(const K &find) const {
+            return keys.lower_bound(size, find);
+        }
+
+        // compares the key at 'ind' with 'key' as check() does
+        template <Compare operation, class K>
+        bool check_key(std::size_t ind, const K &key) const {
+            return keys.template check_key<operation>(ind, key);
+        }
+
+        Key take_key(std::size_t ind) { return keys.take(ind); }
+
+        template <class forward_type>
+        void set_key(std::size_t ind, forward_type &&key) {
+            keys.assign(size, ind, std::forward<forward_type>(key));
+        }
+
+        void copy_keys(const InternalNode *source) {
+            keys.copy(source->keys, source->size);
+            size = source->size;
+        }
+
+        // the node is full once it has internal_size keys; packed separators may run out of characters first, but a
+        // node takes its first two whatever their length, so that it always has two halves to split into
+        bool has_room(const Key &key) const {
+            if constexpr (truncated) {
+                if (size >= min_size && !keys.fits(size, {key, {}})) {
+                    return false;
+                }
+            }
+            return size < internal_size;
+        }
+
+        // whether the node is below the minimum fill once the key 'ind' is gone ('size' for none): with fewer than
+        // internal_min keys, which for packed separators must also take less than half of the characters
+        bool thin(const std::size_t ind) const {
+            const std::size_t count = ind < size ? size - 1 : size;
+            if constexpr (truncated) {
+                const std::size_t gone = ind < size ? keys.offsets[ind + 1] - keys.offsets[ind] : 0;
+                return count < internal_min && 2 * (keys.charged(size) - gone) < keys.inline_size;
             }
-            if (node->is_leaf) {
-                if (this->children[1] != nullptr) {
-                    this->children[1]->children[0] = node;
+            return count < internal_min;
+        }
+
+        bool thin() const { return thin(size); }
+
+        // whether the node can give its first or its last key to a sibling and stay above the minimum
+        bool can_lend(const bool front) const { return size > 1 && !thin(front ? 0 : size - 1); }
+
+        // whether the node, 'next' and the key between them, the key 'ind' of 'parent', fit into a single node
+        bool can_merge(const InternalNode *next, const InternalNode *parent, const std::size_t ind) const {
+            if constexpr (truncated) {
+                if (keys.joined(size, parent->keys.whole(ind), next->keys, next->size) > keys.inline_size) {
+                    return false;
                 }
-                node->children[0] = this;
-                node->children[1] = this->children[1];
-                this->children[1] = node;
-            } else {
-                this->size--;
-                for (std::size_t i = start; i <= finish; i++) {
-                    std::swap(node->children[i - start], this->children[i]);
-                    if (node->children[i - start] != nullptr) {
-                        node->children[i - start]->parent = node;
+            }
+            return size + 1 + next->size <= internal_size;
+        }
+
+        // the number of keys that stay here when 'key' comes in at 'ind' and the node splits, 'mid' if it is full
+        // of keys. Packed separators that ran out of characters first are split at the same share of characters
+        std::size_t split_point(const std::size_t ind, const Key &key, const std::size_t mid) const {
+            if constexpr (truncated) {
+                if (size < internal_size) {
+                    const auto length = [&](const std::size_t i) {
+                        return i == ind ? key.size() : i < ind ? keys.whole(i).size() : keys.whole(i - 1).size();
+                    };
+                    std::size_t total = 0;
+                    for (std::size_t i = 0; i <= size; i++) {
+                        total += length(i);
                     }
+                    std::size_t stay = 0;
+                    std::size_t kept = 0;
+                    while (stay + 1 < size && (kept + length(stay)) * (internal_size + 1) <= total * mid) {
+                        kept += length(stay++);
+                    }
+                    return std::max<std::size_t>(stay, 1);
                 }
             }
-            return node;
+            return mid;
         }
-    };
-
-    template <class iterator_value>
-    class CustomIterator {
-    public:
-        using iterator_category = std::forward_iterator_tag;
-        using difference_type   = std::ptrdiff_t;
-        using value_type        = std::pair<Key, Value>;
-        using pointer           = iterator_value *;
-        using reference         = iterator_value &;
-
-    private:
-        using iterator_type       = CustomIterator<iterator_value>;
-        using const_iterator_type = CustomIterator<const iterator_value>;
-        using node_type           = Node;
-        node_type *leaf;
-        std::size_t ind = 0;
 
-    public:
-        CustomIterator() : leaf(nullptr) {}
+        // the children are moved around only here, so that their counts and aggregates follow them
+        void take_child(std::size_t to, const InternalNode *source, std::size_t from) {
+            children[to] = source->children[from];
+            if constexpr (OrderStatistics) {
+                this->counts[to] = source->counts[from];
+            }
+            if constexpr (aggregated) {
+                this->aggregates[to] = source->aggregates[from];
+            }
+        }
 
-        CustomIterator(node_type *leaf) { this->leaf = leaf; }
+        void put_child(std::size_t ind, Node *child) {
+            children[ind] = child;
+            refresh_child(ind);
+        }
 
-        CustomIterator(node_type *leaf, std::size_t ind) : leaf(leaf), ind(ind) {}
+        void refresh_child(std::size_t ind) {
+            if constexpr (OrderStatistics) {
+                this->counts[ind] = subtree_size(children[ind]);
+            }
+            if constexpr (aggregated) {
+                this->aggregates[ind] = subtree_aggregate(children[ind]);
+            }
+        }
 
-        operator const_iterator_type() const { return const_iterator_type(leaf, ind); }
+        // puts the key at 'ind' and the child right after it
+        template <class forward_type>
+        void insert_at(std::size_t ind, forward_type &&key, Node *child) {
+            keys.insert(size, ind, std::forward<forward_type>(key));
+            for (std::size_t i = size; i > ind; i--) {
+                take_child(i + 1, this, i);
+            }
+            put_child(ind + 1, child);
+            size++;
+        }
 
-        reference operator*() const { return leaf->keys[ind]; }
+        template <class forward_type>
+        void push_front(forward_type &&key, Node *child) {
+            keys.insert(size, 0, std::forward<forward_type>(key));
+            for (std::size_t i = size + 1; i > 0; i--) {
+                take_child(i, this, i - 1);
+            }
+            put_child(0, child);
+            size++;
+        }
 
-        pointer operator->() const { return &(operator*()); }
+        // removes the key at 'ind' together with the child right after it
+        void delete_by_ind(std::size_t ind) {
+            keys.erase(size, ind, 1);
+            for (std::size_t i = ind; i + 1 < size; i++) {
+                take_child(i + 1, this, i + 2);
+            }
+            children[size] = nullptr;
+            size--;
+        }
 
-        iterator_type &operator++() {
-            ind++;
-            if (ind == leaf->size) {
-                ind  = 0;
-                leaf = leaf->children[1];
+        void pop_front() {
+            keys.erase(size, 0, 1);
+            for (std::size_t i = 0; i < size; i++) {
+                take_child(i, this, i + 1);
             }
-            return *this;
+            children[size] = nullptr;
+            size--;
         }
 
-        iterator_type operator++(int) {
-            iterator_type tmp = *this;
-            ++(*this);
-            return tmp;
+        // removes the last key together with the last child
+        void pop_back() {
+            keys.truncate(size, size - 1);
+            children[size] = nullptr;
+            size--;
         }
 
-        friend bool operator==(const iterator_type &a, const iterator_type &b) {
-            return a.ind == b.ind && a.leaf == b.leaf;
+        // removes the children [from, to) along with one separator each: the one on the left if the run reaches the
+        // last child, the one on the right otherwise
+        void delete_children(std::size_t from, std::size_t to) {
+            const std::size_t count = to - from;
+            keys.erase(size, to == size + 1 ? from - 1 : from, count);
+            for (std::size_t i = from; i + count <= size; i++) {
+                take_child(i, this, i + count);
+            }
+            for (std::size_t i = size + 1 - count; i <= size; i++) {
+                children[i] = nullptr;
+            }
+            size -= count;
         }
 
-        friend bool operator!=(const iterator_type &a, const iterator_type &b) {
-            return !(a.ind == b.ind && a.leaf == b.leaf);
+        // splits a full node while inserting 'key' at 'ind' and 'child' right after it; 'mid' keys stay here and
+        // the rest goes to 'right', the separator between the halves is returned
+        template <class forward_type>
+        Key split_node(InternalNode *right, std::size_t ind, forward_type &&key, Node *child, const std::size_t mid) {
+            if (ind == mid) {
+                Key up = std::forward<forward_type>(key);
+                right->put_child(0, child);
+                right->keys.append(0, keys, mid, size);
+                keys.truncate(size, mid);
+                for (std::size_t i = mid; i < size; i++) {
+                    right->take_child(i - mid + 1, this, i + 1);
+                    children[i + 1] = nullptr;
+                }
+                right->size = size - mid;
+                size        = mid;
+                return up;
+            }
+            const std::size_t start = ind < mid ? mid - 1 : mid;
+            Key up                  = keys.take(start);
+            right->keys.append(0, keys, start + 1, size);
+            keys.truncate(size, start);
+            for (std::size_t i = start + 1; i <= size; i++) {
+                right->take_child(i - start - 1, this, i);
+                children[i] = nullptr;
+            }
+            right->size = size - start - 1;
+            size        = start;
+            if (ind < mid) {
+                insert_at(ind, std::forward<forward_type>(key), child);
+            } else {
+                right->insert_at(ind - start - 1, std::forward<forward_type>(key), child);
+            }
+            return up;
+        }
+
+        void merge(InternalNode *next, Key &&element) {
+            keys.insert(size, size, std::move(element));
+            keys.append(size + 1, next->keys, 0, next->size);
+            for (std::size_t i = 0; i <= next->size; i++) {
+                take_child(size + 1 + i, next, i);
+            }
+            size += next->size + 1;
+            next->size = 0;
         }
     };
 
-public:
-    using key_type        = Key;
-    using mapped_type     = Value;
-    using value_type      = std::pair<Key, Value>;  // NB: a digression from std::map
-    using reference       = value_type &;
-    using const_reference = const value_type &;
-    using pointer         = value_type *;
-    using const_pointer   = const value_type *;
-    using size_type       = std::size_t;
+    struct LeafNode: BlockSized<LeafData> {
+        using LeafData::next;
+        using LeafData::prev;
+        using LeafData::slots;
+        using Node::is_leaf;
+        using Node::size;
 
-    using iterator       = CustomIterator<value_type>;
-    using const_iterator = CustomIterator<const value_type>;
+        LeafNode() {
+            size    = 0;
+            is_leaf = true;
+            prev    = nullptr;
+            next    = nullptr;
+        }
 
-    BPTree() {}
+        template <class K>
+        std::size_t getChildIndex(const K &find) const {
+            return Search::template lower_bound<Less>(slots, size, find, SlotKey{});
+        }
+
+        template <class K>
+        std::size_t getUpperIndex(const K &find) const {
+            return Search::template upper_bound<Less>(slots, size, find, SlotKey{});
+        }
 
-    BPTree(std::initializer_list<std::pair<Key, Value>> list) {
-        for (auto element : list) {
-            insert(element.first, element.second);
+        template <class K>
+        std::size_t getIndex(const K &find) const {
+            const std::size_t ind = getChildIndex(find);
+            if (ind < size && check<Compare::greater_equal>(find, slots[ind].first)) {
+                return ind;
+            }
+            return neutral;
+        }
+
+        // shifts the slots from 'ind' on to the right, the caller fills the slot at 'ind'
+        void make_room(std::size_t ind) {
+            for (std::size_t i = size; i > ind; i--) {
+                slots[i] = std::move(slots[i - 1]);
+            }
+            size++;
+        }
+
+        // merges the sorted run [first, last), which has 'fresh' keys that are not here yet, from the back, so that
+        // every slot moves at most once; the keys that are here get the values of the run
+        template <class RandomIt>
+        void merge_run(RandomIt first, RandomIt last, const std::size_t fresh) {
+            std::size_t ind  = size;
+            std::size_t slot = size + fresh;
+            RandomIt element = last;
+            while (element != first && slot != ind) {
+                --element;
+                for (; ind > 0 && check<Compare::less>(element->first, slots[ind - 1].first); ind--) {
+                    slots[--slot] = std::move(slots[ind - 1]);
+                }
+                if (ind > 0 && check<Compare::equal>(element->first, slots[ind - 1].first)) {
+                    slots[ind - 1].second = std::move(element->second);
+                    if (--slot != --ind) {
+                        slots[slot] = std::move(slots[ind]);
+                    }
+                } else {
+                    slots[--slot] = std::move(*element);
+                }
+            }
+            // the slots left of the gap stay where they are
+            while (element != first) {
+                --element;
+                slots[getChildIndex(element->first)].second = std::move(element->second);
+            }
+            size += fresh;
+        }
+
+        template <class forward_type>
+        void insert_at(std::size_t ind, forward_type &&element) {
+            make_room(ind);
+            slots[ind] = std::forward<forward_type>(element);
+        }
+
+        void delete_by_ind(std::size_t ind) {
+            for (std::size_t i = ind; i + 1 < size; i++) {
+                slots[i] = std::move(slots[i + 1]);
+            }
+            size--;
+            slots[size] = std::pair<Key, Value>();
+        }
+
+        // removes the slots [from, to) with a single shift; an empty range is left alone, since the shift would move
+        // every slot onto itself and a self-moved std::string is left empty
+        void delete_range(std::size_t from, std::size_t to) {
+            const std::size_t count = to - from;
+            if (count == 0) {
+                return;
+            }
+            for (std::size_t i = from; i + count < size; i++) {
+                slots[i] = std::move(slots[i + count]);
+            }
+            for (std::size_t i = size - count; i < size; i++) {
+                slots[i] = std::pair<Key, Value>();
+            }
+            size -= count;
+        }
+
+        void link_after(LeafNode *node) {
+            prev = node;
+            next = node->next;
+            if (next != nullptr) {
+                next->prev = this;
+            }
+            node->next = this;
+        }
+
+        void unlink() {
+            if (prev != nullptr) {
+                prev->next = next;
+            }
+            if (next != nullptr) {
+                next->prev = prev;
+            }
+        }
+
+        // splits a full leaf and makes room for a new slot at 'ind', 'mid' slots stay here and the rest goes to
+        // 'right'; returns the leaf holding the new slot, 'ind' becomes its position there
+        LeafNode *split_node(LeafNode *right, std::size_t &ind, const std::size_t mid) {
+            const std::size_t start = ind < mid ? mid - 1 : mid;
+            for (std::size_t i = start; i < size; i++) {
+                right->slots[i - start] = std::move(slots[i]);
+                slots[i]                = std::pair<Key, Value>();
+            }
+            right->size = size - start;
+            size        = start;
+            right->link_after(this);
+            if (ind < mid) {
+                make_room(ind);
+                return this;
+            }
+            ind -= start;
+            right->make_room(ind);
+            return right;
+        }
+
+        void merge(LeafNode *next_leaf) {
+            for (std::size_t i = 0; i < next_leaf->size; i++) {
+                slots[size + i] = std::move(next_leaf->slots[i]);
+            }
+            size += next_leaf->size;
+            next_leaf->size = 0;
+            next_leaf->unlink();
+        }
+    };
+
+    static constexpr std::size_t node_bytes = std::max(sizeof(InternalNode), sizeof(LeafNode));
+    static constexpr std::size_t node_align = std::max(alignof(InternalNode), alignof(LeafNode));
+
+    // nodes are aligned to the block if it is a power of two, so that none of them straddles a page
+    using NodeAllocator =
+        Allocator<node_bytes, (BlockSize & (BlockSize - 1)) == 0 ? std::max(BlockSize, node_align) : node_align>;
+
+    // the internal nodes from the root down to a leaf, each with the position of the next node in it
+    using Path = std::vector<std::pair<InternalNode *, std::size_t>>;
+
+    // end() has no leaf, so an iterator keeps the rightmost leaf as of its making, or the last one it left, and steps
+    // back from end() along the leaf chain from there; nothing points into the tree object, which may be moved
+    template <class iterator_value>
+    class CustomIterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = std::pair<Key, Value>;
+        using pointer           = iterator_value *;
+        using reference         = iterator_value &;
+
+    private:
+        using iterator_type       = CustomIterator<iterator_value>;
+        using const_iterator_type = CustomIterator<const iterator_value>;
+        using node_type           = LeafNode;
+        node_type *leaf;
+        std::size_t ind        = 0;
+        node_type *last = nullptr;
+
+        friend class BPTree;
+
+    public:
+        CustomIterator() : leaf(nullptr) {}
+
+        CustomIterator(node_type *leaf, std::size_t ind, node_type *last) : leaf(leaf), ind(ind), last(last) {}
+
+        operator const_iterator_type() const { return const_iterator_type(leaf, ind, last); }
+
+        reference operator*() const { return leaf->slots[ind]; }
+
+        pointer operator->() const { return &(operator*()); }
+
+        iterator_type &operator++() {
+            ind++;
+            if (ind == leaf->size) {
+                ind  = 0;
+                last = leaf;
+                leaf = leaf->next;
+            }
+            return *this;
+        }
+
+        iterator_type operator++(int) {
+            iterator_type tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        iterator_type &operator--() {
+            if (leaf == nullptr) {
+                for (leaf = last; leaf->next != nullptr;) {
+                    leaf = leaf->next;
+                }
+                ind = leaf->size;
+            } else if (ind == 0) {
+                leaf = leaf->prev;
+                ind  = leaf->size;
+            }
+            ind--;
+            return *this;
+        }
+
+        iterator_type operator--(int) {
+            iterator_type tmp = *this;
+            --(*this);
+            return tmp;
+        }
+
+        friend bool operator==(const iterator_type &a, const iterator_type &b) {
+            return a.ind == b.ind && a.leaf == b.leaf;
+        }
+
+        friend bool operator!=(const iterator_type &a, const iterator_type &b) {
+            return !(a.ind == b.ind && a.leaf == b.leaf);
+        }
+    };
+
+public:
+    using key_type        = Key;
+    using mapped_type     = Value;
+    using value_type      = std::pair<Key, Value>;  // NB: a digression from std::map
+    using reference       = value_type &;
+    using const_reference = const value_type &;
+    using pointer         = value_type *;
+    using const_pointer   = const value_type *;
+    using size_type       = std::size_t;
+
+    // with an aggregate policy the values are read-only through iterators and 'at', a value changes only through
+    // insert, insert_or_assign, operator[] and the like, which refresh the aggregates above it
+    using iterator               = CustomIterator<std::conditional_t<aggregated, const value_type, value_type>>;
+    using const_iterator         = CustomIterator<const value_type>;
+    using reverse_iterator       = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    // both kinds of nodes occupy exactly BlockSize bytes unless the block is too small to hold a node of the minimal
+    // order; internal nodes keep only keys, so their fanout does not depend on Value
+    static constexpr std::size_t internal_node_size() { return sizeof(InternalNode); }
+    static constexpr std::size_t leaf_node_size() { return sizeof(LeafNode); }
+    static constexpr std::size_t internal_capacity() { return internal_size; }
+    static constexpr std::size_t leaf_capacity() { return leaf_size; }
+
+    BPTree() {}
+
+    BPTree(std::initializer_list<std::pair<Key, Value>> list) { bulk_load(list.begin(), list.end()); }
+
+    template <class ForwardIt>
+    static BPTree from_sorted(ForwardIt begin, ForwardIt end, const double fill_factor = 1.0) {
+        BPTree tree;
+        tree.bulk_load(begin, end, fill_factor);
+        return tree;
+    }
+
+    // builds the tree on 'threads' threads (all cores if 0): the chunks of 'data' are sorted in parallel and merged
+    // pairwise, then the leaves and every internal level are filled in parallel; of equal keys the last one wins
+    static BPTree from_unsorted(std::vector<std::pair<Key, Value>> data, std::size_t threads = 0,
+                                const double fill_factor = 1.0) {
+        if (!(fill_factor > 0 && fill_factor <= 1)) {
+            throw std::invalid_argument("Incorrect fill factor");
+        }
+        if (threads == 0) {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        parallel_sort(data, threads);
+        std::size_t distinct = 0;
+        for (std::size_t i = 0; i < data.size(); i++) {
+            if (i + 1 == data.size() || check<Compare::less>(data[i].first, data[i + 1].first)) {
+                if (distinct != i) {
+                    data[distinct] = std::move(data[i]);
+                }
+                distinct++;
+            }
+        }
+        BPTree tree;
+        if (distinct == 0) {
+            return tree;
+        }
+        const std::vector<std::size_t> sizes = plan(distinct, fill_factor, leaf_size, leaf_min, 0);
+        std::vector<std::size_t> offsets(sizes.size(), 0);
+        for (std::size_t i = 1; i < sizes.size(); i++) {
+            offsets[i] = offsets[i - 1] + sizes[i - 1];
+        }
+        std::vector<Node *> level(sizes.size(), nullptr);
+        std::vector<const Key *> maxima(sizes.size(), nullptr);
+        const std::vector<void *> blocks = tree.allocate_blocks(sizes.size());
+        parallel_for(sizes.size(), threads, [&](const std::size_t start, const std::size_t finish) {
+            for (std::size_t i = start; i < finish; i++) {
+                LeafNode *leaf = ::new (blocks[i]) LeafNode();
+                std::move(data.begin() + offsets[i], data.begin() + offsets[i] + sizes[i], leaf->slots);
+                leaf->size = sizes[i];
+                level[i]   = leaf;
+                maxima[i]  = &leaf->slots[leaf->size - 1].first;
+            }
+        });
+        for (std::size_t i = 1; i < level.size(); i++) {
+            static_cast<LeafNode *>(level[i])->link_after(static_cast<LeafNode *>(level[i - 1]));
+        }
+        tree.first_node = static_cast<LeafNode *>(level.front());
+        tree.last_node  = static_cast<LeafNode *>(level.back());
+        tree.tree_size  = distinct;
+        tree.build_levels(std::move(level), std::move(maxima), fill_factor, threads);
+        return tree;
+    }
+
+private:
+    Node *copy_node(const Node *source, LeafNode *&prev_leaf) {
+        if (source->is_leaf) {
+            const LeafNode *source_leaf = static_cast<const LeafNode *>(source);
+            LeafNode *leaf              = create<LeafNode>();
+            leaf->size                  = source_leaf->size;
+            for (std::size_t i = 0; i < source_leaf->size; i++) {
+                leaf->slots[i] = source_leaf->slots[i];
+            }
+            if (prev_leaf == nullptr) {
+                first_node = leaf;
+            } else {
+                leaf->link_after(prev_leaf);
+            }
+            prev_leaf = leaf;
+            return leaf;
+        }
+        const InternalNode *source_node = static_cast<const InternalNode *>(source);
+        InternalNode *node              = create<InternalNode>();
+        node->copy_keys(source_node);
+        for (std::size_t i = 0; i <= source_node->size; i++) {
+            node->put_child(i, copy_node(source_node->children[i], prev_leaf));
+        }
+        return node;
+    }
+
+    void copy(const BPTree &prototype) {
+        clear();
+        if (prototype.root == nullptr) {
+            return;
+        }
+        LeafNode *prev_leaf = nullptr;
+        root                = copy_node(prototype.root, prev_leaf);
+        last_node           = prev_leaf;
+        tree_size           = prototype.tree_size;
+    }
+
+    void move_source(BPTree &&prototype) {
+        clear();
+        allocator.swap(prototype.allocator);
+        std::swap(root, prototype.root);
+        std::swap(first_node, prototype.first_node);
+        std::swap(last_node, prototype.last_node);
+        std::swap(tree_size, prototype.tree_size);
+        std::swap(appending, prototype.appending);
+    }
+
+    template <class node_type>
+    node_type *create() {
+        void *block = allocator.allocate();
+        try {
+            return ::new (block) node_type();
+        } catch (...) {
+            allocator.deallocate(block);
+            throw;
+        }
+    }
+
+    // raw blocks for nodes that are constructed later, possibly on other threads
+    std::vector<void *> allocate_blocks(const std::size_t count) {
+        std::vector<void *> blocks(count);
+        for (void *&block : blocks) {
+            block = allocator.allocate();
+        }
+        return blocks;
+    }
+
+    static void destruct(Node *node) {
+        if (node->is_leaf) {
+            static_cast<LeafNode *>(node)->~LeafNode();
+        } else {
+            static_cast<InternalNode *>(node)->~InternalNode();
+        }
+    }
+
+    void delete_node(Node *node) {
+        destruct(node);
+        allocator.deallocate(node);
+    }
+
+    // runs the destructors of the subtree; blocks go back one by one only if the allocator cannot release them all at
+    // once, so with a pooling allocator and trivially destructible keys, values and aggregates there is nothing to
+    // visit
+    void destroy(Node *node) {
+        if constexpr (!NodeAllocator::releases_all || !std::is_trivially_destructible_v<value_type> ||
+                      !std::is_trivially_destructible_v<aggregate_type>) {
+            if (!node->is_leaf) {
+                InternalNode *internal = static_cast<InternalNode *>(node);
+                for (std::size_t i = 0; i <= internal->size; i++) {
+                    destroy(internal->children[i]);
+                }
+            }
+            if constexpr (NodeAllocator::releases_all) {
+                destruct(node);
+            } else {
+                delete_node(node);
+            }
+        }
+    }
+
+public:
+    BPTree(const BPTree &prototype) { copy(prototype); }
+
+    BPTree(BPTree &&prototype) { move_source(std::move(prototype)); }
+
+    iterator begin() { return make_iterator(first_node, 0); }
+
+    const_iterator cbegin() const { return make_iterator(first_node, 0); }
+
+    const_iterator begin() const { return cbegin(); }
+
+    iterator end() { return make_iterator(nullptr, 0); }
+
+    const_iterator cend() const { return make_iterator(nullptr, 0); }
+
+    const_iterator end() const { return cend(); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+
+    const_reverse_iterator crbegin() const { return const_reverse_iterator(cend()); }
+
+    const_reverse_iterator rbegin() const { return crbegin(); }
+
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+
+    const_reverse_iterator crend() const { return const_reverse_iterator(cbegin()); }
+
+    const_reverse_iterator rend() const { return crend(); }
+
+    bool empty() const { return root == nullptr; }
+
+    size_type size() const { return tree_size; }
+
+    ~BPTree() { clear(); }
+
+    void clear() {
+        tree_size = 0;
+        appending = false;
+        if (root != nullptr) {
+            destroy(root);
+        }
+        allocator.release();
+        root       = nullptr;
+        first_node = nullptr;
+        last_node  = nullptr;
+    }
+
+    size_type count(const Key &key) const { return contains(key); }
+
+    bool contains(const Key &key) const {
+        LeafNode *tmp = find_leaf(key);
+        return tmp != nullptr && tmp->getIndex(key) != neutral;
+    }
+
+    std::pair<iterator, iterator> equal_range(const Key &key) {
+        iterator start  = lower_bound(key);
+        iterator finish = start;
+        if (start != end() && check<Compare::equal>(key, start->first)) {
+            finish++;
+        }
+        return {start, finish};
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const Key &key) const {
+        const_iterator start  = lower_bound(key);
+        const_iterator finish = start;
+        if (start != end() && check<Compare::equal>(key, start->first)) {
+            finish++;
+        }
+        return {start, finish};
+    }
+
+    iterator lower_bound(const Key &key) {
+        std::pair<LeafNode *, std::size_t> tmp = tree_lower_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    const_iterator lower_bound(const Key &key) const {
+        std::pair<LeafNode *, std::size_t> tmp = tree_lower_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    iterator upper_bound(const Key &key) {
+        std::pair<LeafNode *, std::size_t> tmp = tree_upper_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    const_iterator upper_bound(const Key &key) const {
+        std::pair<LeafNode *, std::size_t> tmp = tree_upper_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    iterator find(const Key &key) {
+        std::pair<LeafNode *, std::size_t> tmp = tree_find(key);
+        if (tmp.first == nullptr) {
+            return end();
+        }
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    const_iterator find(const Key &key) const {
+        std::pair<LeafNode *, std::size_t> tmp = tree_find(key);
+        if (tmp.first == nullptr) {
+            return end();
+        }
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    // heterogeneous lookup: with a transparent Less anything it compares with Key, such as a std::string_view for
+    // std::string keys, is searched for as is instead of being converted to a temporary Key first
+    template <class K, class = transparent_t<K>>
+    size_type count(const K &key) const { return contains(key); }
+
+    template <class K, class = transparent_t<K>>
+    bool contains(const K &key) const {
+        LeafNode *tmp = find_leaf(key);
+        return tmp != nullptr && tmp->getIndex(key) != neutral;
+    }
+
+    template <class K, class = transparent_t<K>>
+    std::pair<iterator, iterator> equal_range(const K &key) {
+        iterator start = lower_bound(key);
+        return {start, start != end() && check<Compare::equal>(key, start->first) ? std::next(start) : start};
+    }
+
+    template <class K, class = transparent_t<K>>
+    std::pair<const_iterator, const_iterator> equal_range(const K &key) const {
+        const_iterator start = lower_bound(key);
+        return {start, start != end() && check<Compare::equal>(key, start->first) ? std::next(start) : start};
+    }
+
+    template <class K, class = transparent_t<K>>
+    iterator lower_bound(const K &key) {
+        std::pair<LeafNode *, std::size_t> tmp = tree_lower_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    template <class K, class = transparent_t<K>>
+    const_iterator lower_bound(const K &key) const {
+        std::pair<LeafNode *, std::size_t> tmp = tree_lower_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    template <class K, class = transparent_t<K>>
+    iterator upper_bound(const K &key) {
+        std::pair<LeafNode *, std::size_t> tmp = tree_upper_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    template <class K, class = transparent_t<K>>
+    const_iterator upper_bound(const K &key) const {
+        std::pair<LeafNode *, std::size_t> tmp = tree_upper_bound(key);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    template <class K, class = transparent_t<K>>
+    iterator find(const K &key) {
+        std::pair<LeafNode *, std::size_t> tmp = tree_find(key);
+        return tmp.first != nullptr ? make_iterator(tmp.first, tmp.second) : end();
+    }
+
+    template <class K, class = transparent_t<K>>
+    const_iterator find(const K &key) const {
+        std::pair<LeafNode *, std::size_t> tmp = tree_find(key);
+        return tmp.first != nullptr ? make_iterator(tmp.first, tmp.second) : end();
+    }
+
+    // writes find(key) to 'out' for every key of [first, last) in turn. A sorted batch walks the tree once, going up
+    // only as far as the next key needs; any other batch descends for several keys at once, one level at a time,
+    // prefetching the nodes of every key before any of them is searched, so the cache misses overlap
+    template <class ForwardIt, class OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        find_leaves(first, last, [this, &out](const Key &key, LeafNode *leaf) {
+            const std::size_t ind = leaf != nullptr ? leaf->getIndex(key) : neutral;
+            *out++                = ind != neutral ? make_iterator(leaf, ind) : cend();
+        });
+        return out;
+    }
+
+    // writes contains(key) to 'out' for every key of [first, last) in turn, see find_many
+    template <class ForwardIt, class OutputIt>
+    OutputIt contains_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        find_leaves(first, last, [&out](const Key &key, const LeafNode *leaf) {
+            *out++ = leaf != nullptr && leaf->getIndex(key) != neutral;
+        });
+        return out;
+    }
+
+    // calls 'callback(first, last)' for every run of consecutive elements of [lo, hi) within a leaf, prefetching the
+    // leaves ahead; a callback returning bool stops the scan with false
+    template <class Callback>
+    void scan_chunks(const Key &lo, const Key &hi, Callback callback) const {
+        if (!check<Compare::less>(lo, hi)) {
+            return;
+        }
+        std::pair<LeafNode *, std::size_t> start = tree_lower_bound(lo);
+        LeafNode *leaf                           = start.first;
+        LeafNode *ahead                          = leaf != nullptr ? leaf->next : nullptr;
+        prefetch_node(ahead);
+        for (std::size_t from = start.second; leaf != nullptr; leaf = leaf->next, from = 0) {
+            if (ahead != nullptr) {
+                ahead = ahead->next;
+                prefetch_node(ahead);
+            }
+            const bool last       = !check<Compare::greater>(hi, leaf->slots[leaf->size - 1].first);
+            const std::size_t to  = last ? leaf->getChildIndex(hi) : leaf->size;
+            const value_type *run = leaf->slots;
+            if constexpr (std::is_same_v<std::invoke_result_t<Callback &, const value_type *, const value_type *>,
+                                         bool>) {
+                if (!callback(run + from, run + to)) {
+                    return;
+                }
+            } else {
+                callback(run + from, run + to);
+            }
+            if (last) {
+                return;
+            }
+        }
+    }
+
+    // calls 'callback(element)' for every element of [lo, hi) in order; a callback returning bool stops the scan
+    // with false
+    template <class Callback>
+    void scan(const Key &lo, const Key &hi, Callback callback) const {
+        scan_chunks(lo, hi, [&callback](const value_type *first, const value_type *last) {
+            for (; first != last; ++first) {
+                if constexpr (std::is_same_v<std::invoke_result_t<Callback &, const value_type &>, bool>) {
+                    if (!callback(*first)) {
+                        return false;
+                    }
+                } else {
+                    callback(*first);
+                }
+            }
+            return true;
+        });
+    }
+
+    // the number of elements less than 'key', in O(log n); this and the rest of the order statistics below are
+    // available only with the OrderStatistics flag
+    size_type rank(const Key &key) const {
+        static_assert(OrderStatistics, "order statistics need the OrderStatistics flag of the tree");
+        size_type result = 0;
+        Node *tmp        = root;
+        while (tmp != nullptr && !tmp->is_leaf) {
+            InternalNode *node    = static_cast<InternalNode *>(tmp);
+            const std::size_t ind = node->getChildIndex(key);
+            for (std::size_t i = 0; i < ind; i++) {
+                result += node->counts[i];
+            }
+            tmp = node->children[ind];
+        }
+        return tmp != nullptr ? result + static_cast<LeafNode *>(tmp)->getChildIndex(key) : 0;
+    }
+
+    // the element with 'k' elements before it, end() if there are no more than 'k' elements
+    iterator select(size_type k) {
+        std::pair<LeafNode *, std::size_t> tmp = tree_select(k);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    const_iterator select(size_type k) const {
+        std::pair<LeafNode *, std::size_t> tmp = tree_select(k);
+        return make_iterator(tmp.first, tmp.second);
+    }
+
+    // the number of elements of [lo, hi)
+    size_type count_range(const Key &lo, const Key &hi) const {
+        return check<Compare::less>(lo, hi) ? rank(hi) - rank(lo) : 0;
+    }
+
+    // std::distance in O(log n) instead of a walk over the elements
+    typename iterator::difference_type distance(const_iterator first, const_iterator last) const {
+        const auto position = [this](const_iterator it) { return it == end() ? tree_size : rank(it->first); };
+        return static_cast<typename iterator::difference_type>(position(last)) -
+               static_cast<typename iterator::difference_type>(position(first));
+    }
+
+    // combines the values of [lo, hi) in key order, in O(log n) without visiting the leaves in between; available only
+    // with an aggregate policy
+    aggregate_type aggregate(const Key &lo, const Key &hi) const {
+        static_assert(aggregated, "aggregate needs an aggregate policy of the tree");
+        if (root == nullptr || !check<Compare::less>(lo, hi)) {
+            return Aggregate::identity();
+        }
+        return fold<true, true>(root, lo, hi);
+    }
+
+    BPTree &operator=(BPTree &&source) {
+        move_source(std::move(source));
+        return *this;
+    }
+
+    BPTree &operator=(const BPTree &source) {
+        if (this != &source) {
+            copy(source);
+        }
+        return *this;
+    }
+
+    // 'at' method throws std::out_of_range if there is no such key
+    std::conditional_t<aggregated, const Value, Value> &at(const Key &key) {
+        iterator tmp = find(key);
+        if (tmp == end()) {
+            throw std::out_of_range("Incorrect key");
+        }
+        return (tmp->second);
+    }
+
+    const Value &at(const Key &key) const {
+        const_iterator tmp = find(key);
+        if (tmp == end()) {
+            throw std::out_of_range("Incorrect key");
+        }
+        return (tmp->second);
+    }
+
+    // with an aggregate policy operator[] hands out this instead of a reference: the value is read through it and an
+    // assignment to it goes through insert_or_assign, so the aggregates above the value follow it
+    class ValueProxy {
+        BPTree *tree;
+        iterator it;
+
+        friend class BPTree;
+
+        ValueProxy(BPTree *tree, iterator it) : tree(tree), it(it) {}
+
+    public:
+        operator const Value &() const { return it->second; }
+
+        ValueProxy &operator=(const ValueProxy &other) { return *this = static_cast<const Value &>(other); }
+
+        template <class M>
+        ValueProxy &operator=(M &&value) {
+            it = tree->emplace_key(it.leaf, true, it->first, std::forward<M>(value)).first;
+            return *this;
+        }
+    };
+
+    using value_reference = std::conditional_t<aggregated, ValueProxy, Value &>;
+
+    // '[]' operator inserts a new element if there is no such key
+    value_reference operator[](const Key &key) { return value_at(emplace_key(nullptr, false, key).first); }
+
+    value_reference operator[](Key &&key) { return value_at(emplace_key(nullptr, false, std::move(key)).first); }
+
+    // NB: a digression from std::map, the value of an existing key is overwritten as with insert_or_assign
+    std::pair<iterator, bool> insert(const Key &key, const Value &value) {
+        return emplace_key(nullptr, true, key, value);
+    }
+
+    std::pair<iterator, bool> insert(const Key &key, Value &&value) {
+        return emplace_key(nullptr, true, key, std::move(value));
+    }
+
+    // the hint saves the descent if the key belongs to its leaf; end() stands for the rightmost leaf, so appending
+    // increasing keys with end() as the hint never descends
+    iterator insert(const_iterator hint, const value_type &value) {
+        return emplace_key(hint_leaf(hint), true, value.first, value.second).first;
+    }
+
+    iterator insert(const_iterator hint, value_type &&value) {
+        return emplace_key(hint_leaf(hint), true, std::move(value.first), std::move(value.second)).first;
+    }
+
+    template <class... Args>
+    iterator emplace_hint(const_iterator hint, Args &&...args) {
+        if constexpr (sizeof...(Args) == 2) {
+            return emplace_key(hint_leaf(hint), false, std::forward<Args>(args)...).first;
+        } else {
+            value_type element(std::forward<Args>(args)...);
+            return emplace_key(hint_leaf(hint), false, std::move(element.first), std::move(element.second)).first;
+        }
+    }
+
+    // a key and a value (or anything that makes a pair of them) go to the leaf directly, an existing key is kept
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args &&...args) {
+        if constexpr (sizeof...(Args) == 2) {
+            return emplace_key(nullptr, false, std::forward<Args>(args)...);
+        } else {
+            value_type element(std::forward<Args>(args)...);
+            return emplace_key(nullptr, false, std::move(element.first), std::move(element.second));
+        }
+    }
+
+    // the value is made from 'args' only if there is no such key yet
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args) {
+        return emplace_key(nullptr, false, key, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(Key &&key, Args &&...args) {
+        return emplace_key(nullptr, false, std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const Key &key, M &&value) {
+        return emplace_key(nullptr, true, key, std::forward<M>(value));
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(Key &&key, M &&value) {
+        return emplace_key(nullptr, true, std::move(key), std::forward<M>(value));
+    }
+
+    // NB: a digression from std::map
+    template <class ForwardIt>
+    void insert(ForwardIt begin, ForwardIt end) {
+        if (root == nullptr) {
+            bulk_load(begin, end);
+            return;
+        }
+        ForwardIt element = begin;
+        while (element != end) {
+            emplace_key(nullptr, true, element->first, element->second);
+            element++;
+        }
+    }
+
+    void insert(std::initializer_list<std::pair<Key, Value>> list) { insert(list.begin(), list.end()); }
+
+    // inserts the elements of [first, last) or assigns their values, as insert does, visiting every leaf only once:
+    // the batch is sorted, every run of it that falls into one leaf is merged into the leaf in a single pass, and the
+    // leaves that overflow are cut into as many nodes as they need. The new nodes go up level by level, so a parent
+    // is rebuilt and split once however many of its children grew. Of equal keys in the batch the last one wins
+    template <class ForwardIt>
+    void insert_batch(ForwardIt first, ForwardIt last) {
+        std::vector<value_type> batch(first, last);
+        const auto less = [](const value_type &a, const value_type &b) {
+            return check<Compare::less>(a.first, b.first);
+        };
+        if (!std::is_sorted(batch.begin(), batch.end(), less)) {
+            std::stable_sort(batch.begin(), batch.end(), less);
+        }
+        auto distinct = batch.begin();
+        for (auto element = batch.begin(); element != batch.end(); ++element) {
+            if (std::next(element) == batch.end() || less(*element, *std::next(element))) {
+                if (distinct != element) {
+                    *distinct = std::move(*element);
+                }
+                ++distinct;
+            }
+        }
+        batch.erase(distinct, batch.end());
+        if (batch.empty()) {
+            return;
+        }
+        if (root == nullptr) {
+            LeafNode *leaf = create<LeafNode>();
+            root           = leaf;
+            first_node     = leaf;
+            last_node      = leaf;
+        }
+        grow(merge_runs(batch));
+    }
+
+    template <class Range>
+    void insert_batch(const Range &range) {
+        insert_batch(std::begin(range), std::end(range));
+    }
+
+    // replaces the contents with [begin, end), building the tree bottom-up in O(n): leaves are filled to
+    // 'fill_factor' of their capacity and the internal levels are put on top of them. A sorted range is used as is,
+    // anything else is sorted first; of equal keys the last one wins, just as with insert
+    template <class ForwardIt>
+    void bulk_load(ForwardIt begin, ForwardIt end, const double fill_factor = 1.0) {
+        if (!(fill_factor > 0 && fill_factor <= 1)) {
+            throw std::invalid_argument("Incorrect fill factor");
+        }
+        std::size_t distinct = 0;
+        for (ForwardIt element = begin, prev = begin; element != end; prev = element, ++element) {
+            if (element == begin || check<Compare::less>(prev->first, element->first)) {
+                distinct++;
+            } else if (check<Compare::greater>(prev->first, element->first)) {
+                std::vector<value_type> sorted(begin, end);
+                std::stable_sort(sorted.begin(), sorted.end(), [](const value_type &a, const value_type &b) {
+                    return check<Compare::less>(a.first, b.first);
+                });
+                bulk_load(sorted.begin(), sorted.end(), fill_factor);
+                return;
+            }
+        }
+        clear();
+        if (distinct == 0) {
+            return;
+        }
+        std::vector<Node *> level;
+        std::vector<const Key *> maxima;
+        LeafNode *prev    = nullptr;
+        ForwardIt element = begin;
+        for (const std::size_t count : plan(distinct, fill_factor, leaf_size, leaf_min, 0)) {
+            LeafNode *leaf = create<LeafNode>();
+            if (prev == nullptr) {
+                first_node = leaf;
+            } else {
+                leaf->link_after(prev);
+            }
+            while (leaf->size < count) {
+                value_type &slot = leaf->slots[leaf->size++];
+                slot             = value_type(element->first, element->second);
+                for (++element; element != end && check<Compare::equal>(slot.first, element->first); ++element) {
+                    slot.second = element->second;
+                }
+            }
+            level.push_back(leaf);
+            maxima.push_back(&leaf->slots[leaf->size - 1].first);
+            prev = leaf;
+        }
+        last_node = prev;
+        tree_size = distinct;
+        build_levels(std::move(level), std::move(maxima), fill_factor, 1);
+    }
+
+    // writes the elements to 'path' as an image for MappedBPTree, see BPTreeImage.hpp; the image has pages of
+    // BlockSize bytes, so it is mapped by a MappedBPTree with the same BlockSize
+    void save(const std::string &path) const {
+        bptree::ImageWriter<Key, Value, BlockSize> writer(path);
+        for (const value_type &element : *this) {
+            writer.add(element.first, element.second);
+        }
+        writer.finish();
+    }
+
+    // the same elements in an immutable FrozenBPTree, see BPTreeFrozen.hpp; its leaves take FrozenBlockSize bytes
+    template <std::size_t FrozenBlockSize = 256>
+    FrozenBPTree<Key, Value, FrozenBlockSize, Less, Search> freeze() const {
+        return FrozenBPTree<Key, Value, FrozenBlockSize, Less, Search>(begin(), end());
+    }
+
+private:
+    // sizes of the nodes holding 'count' items on one level of a bulk loaded tree; a node takes 'spare' items on top
+    // of its keys (the extra child of an internal node), and the last two nodes share the remainder if it is too small
+    static std::vector<std::size_t> plan(const std::size_t count, const double fill_factor, const std::size_t capacity,
+                                         const std::size_t minimum, const std::size_t spare) {
+        const std::size_t wanted = static_cast<std::size_t>(fill_factor * capacity + 0.5);
+        const std::size_t target = std::clamp(wanted, std::max<std::size_t>(minimum, 1), capacity) + spare;
+        std::vector<std::size_t> sizes((count + target - 1) / target, target);
+        sizes.back() = count - (sizes.size() - 1) * target;
+        if (sizes.size() > 1 && sizes.back() < minimum + spare) {
+            const std::size_t rest = target + sizes.back();
+            sizes.pop_back();
+            if (rest <= capacity + spare) {
+                sizes.back() = rest;
+            } else {
+                sizes.back() = rest - rest / 2;
+                sizes.push_back(rest / 2);
+            }
+        }
+        return sizes;
+    }
+
+    // cuts the internal nodes of 'sizes' further where their packed separators (see NodeKeys) would not fit in the
+    // area, 'separator(i)' being the key in front of the child i: such a node is split into parts of about three
+    // quarters of the area, with at least two children each
+    template <class Separator>
+    static std::vector<std::size_t> refine(const std::vector<std::size_t> &sizes, const Separator &separator) {
+        if constexpr (truncated) {
+            using Keys                 = NodeKeys<internal_size>;
+            constexpr std::size_t area = Keys::inline_size;
+            std::vector<std::size_t> parts;
+            std::size_t child = 0;
+            for (const std::size_t size : sizes) {
+                const std::size_t finish = child + size;
+                std::size_t length       = 0;
+                std::size_t total        = 0;
+                if (size > 1) {
+                    const Key &first = separator(child + 1);
+                    const Key &last  = separator(finish - 1);
+                    length = std::mismatch(first.begin(), first.end(), last.begin(), last.end()).first - first.begin();
+                }
+                for (std::size_t i = child + 1; i < finish; i++) {
+                    total += separator(i).size() - length;
+                }
+                const std::size_t charged = Keys::charge(total + (size - 1) * length, size - 1, length);
+                const std::size_t count   = charged <= area ? 1 : (4 * charged + 3 * area - 1) / (3 * area);
+                std::size_t begin         = child;
+                std::size_t seen          = 0;
+                std::size_t part          = 1;
+                for (std::size_t i = child + 1; i < finish; i++) {
+                    seen += separator(i).size() - length;
+                    if (part < count && seen * count >= total * part && i - begin >= 2 && finish - i >= 2) {
+                        parts.push_back(i - begin);
+                        begin = i;
+                        part++;
+                    }
+                }
+                parts.push_back(finish - begin);
+                child = finish;
+            }
+            return parts;
+        }
+        return sizes;
+    }
+
+    // runs 'work(start, finish)' on up to 'threads' disjoint parts of [0, count), the first part on this thread
+    template <class Work>
+    static void parallel_for(const std::size_t count, std::size_t threads, const Work &work) {
+        threads = std::max<std::size_t>(std::min(threads, count), 1);
+        std::vector<std::future<void>> parts;
+        for (std::size_t i = 1; i < threads; i++) {
+            parts.push_back(std::async(std::launch::async, work, count * i / threads, count * (i + 1) / threads));
+        }
+        work(0, count / threads);
+        for (std::future<void> &part : parts) {
+            part.get();
+        }
+    }
+
+    // stable: the chunks are sorted independently and then merged pairwise, each round in parallel
+    static void parallel_sort(std::vector<std::pair<Key, Value>> &data, const std::size_t threads) {
+        const auto less = [](const value_type &a, const value_type &b) {
+            return check<Compare::less>(a.first, b.first);
+        };
+        const std::size_t chunks = std::max<std::size_t>(std::min(threads, data.size()), 1);
+        const auto bound         = [&](const std::size_t chunk) {
+            return data.begin() + data.size() * std::min(chunk, chunks) / chunks;
+        };
+        parallel_for(chunks, chunks, [&](const std::size_t start, const std::size_t finish) {
+            for (std::size_t i = start; i < finish; i++) {
+                std::stable_sort(bound(i), bound(i + 1), less);
+            }
+        });
+        for (std::size_t width = 1; width < chunks; width *= 2) {
+            const std::size_t merges = (chunks + 2 * width - 1) / (2 * width);
+            parallel_for(merges, merges, [&](const std::size_t start, const std::size_t finish) {
+                for (std::size_t i = start; i < finish; i++) {
+                    const std::size_t first = 2 * width * i;
+                    std::inplace_merge(bound(first), bound(first + width), bound(first + 2 * width), less);
+                }
+            });
+        }
+    }
+
+    // puts the internal levels on top of the linked nodes of 'level', 'maxima' keeps the largest key of each subtree
+    void build_levels(std::vector<Node *> level, std::vector<const Key *> maxima, const double fill_factor,
+                      const std::size_t threads) {
+        while (level.size() > 1) {
+            std::vector<Key> separators(level.size());
+            parallel_for(level.size(), threads, [&](const std::size_t start, const std::size_t finish) {
+                for (std::size_t i = std::max<std::size_t>(start, 1); i < finish; i++) {
+                    separators[i] = separator(*maxima[i - 1], level[i]);
+                }
+            });
+            const std::vector<std::size_t> sizes =
+                refine(plan(level.size(), fill_factor, internal_size, internal_min, 1),
+                       [&separators](const std::size_t child) -> const Key & { return separators[child]; });
+            std::vector<std::size_t> offsets(sizes.size(), 0);
+            for (std::size_t i = 1; i < sizes.size(); i++) {
+                offsets[i] = offsets[i - 1] + sizes[i - 1];
+            }
+            std::vector<Node *> parents(sizes.size(), nullptr);
+            std::vector<const Key *> parent_maxima(sizes.size(), nullptr);
+            const std::vector<void *> blocks = allocate_blocks(sizes.size());
+            parallel_for(sizes.size(), threads, [&](const std::size_t start, const std::size_t finish) {
+                for (std::size_t i = start; i < finish; i++) {
+                    const std::size_t child = offsets[i];
+                    InternalNode *node      = ::new (blocks[i]) InternalNode();
+                    node->put_child(0, level[child]);
+                    for (std::size_t j = 1; j < sizes[i]; j++) {
+                        node->insert_at(j - 1, std::move(separators[child + j]), level[child + j]);
+                    }
+                    parents[i]       = node;
+                    parent_maxima[i] = maxima[child + sizes[i] - 1];
+                }
+            });
+            level.swap(parents);
+            maxima.swap(parent_maxima);
+        }
+        root = level[0];
+    }
+
+    static bool thin(const Node *node) {
+        return node->is_leaf ? node->size < leaf_min : static_cast<const InternalNode *>(node)->thin();
+    }
+
+    // moves 'count' elements from the end of the previous sibling to the front of the child 'ind'
+    void borrow_from_prev(InternalNode *parent, std::size_t ind, std::size_t count) {
+        Node *node = parent->children[ind];
+        Node *prev = parent->children[ind - 1];
+        if (node->is_leaf) {
+            LeafNode *leaf      = static_cast<LeafNode *>(node);
+            LeafNode *prev_leaf = static_cast<LeafNode *>(prev);
+            for (std::size_t i = leaf->size; i > 0; i--) {
+                leaf->slots[i - 1 + count] = std::move(leaf->slots[i - 1]);
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                leaf->slots[i] = std::move(prev_leaf->slots[prev_leaf->size - count + i]);
+            }
+            leaf->size += count;
+            prev_leaf->delete_range(prev_leaf->size - count, prev_leaf->size);
+            parent->set_key(ind - 1, separator(prev_leaf->slots[prev_leaf->size - 1].first, leaf->slots[0].first));
+        } else {
+            InternalNode *internal      = static_cast<InternalNode *>(node);
+            InternalNode *prev_internal = static_cast<InternalNode *>(prev);
+            for (; count > 0; count--) {
+                internal->push_front(parent->take_key(ind - 1), prev_internal->children[prev_internal->size]);
+                parent->set_key(ind - 1, prev_internal->take_key(prev_internal->size - 1));
+                prev_internal->pop_back();
+            }
+        }
+        parent->refresh_child(ind - 1);
+        parent->refresh_child(ind);
+    }
+
+    // moves 'count' elements from the front of the next sibling to the end of the child 'ind'
+    void borrow_from_next(InternalNode *parent, std::size_t ind, std::size_t count) {
+        Node *node = parent->children[ind];
+        Node *next = parent->children[ind + 1];
+        if (node->is_leaf) {
+            LeafNode *leaf      = static_cast<LeafNode *>(node);
+            LeafNode *next_leaf = static_cast<LeafNode *>(next);
+            for (std::size_t i = 0; i < count; i++) {
+                leaf->slots[leaf->size + i] = std::move(next_leaf->slots[i]);
+            }
+            leaf->size += count;
+            next_leaf->delete_range(0, count);
+            parent->set_key(ind, separator(leaf->slots[leaf->size - 1].first, next_leaf->slots[0].first));
+        } else {
+            InternalNode *internal      = static_cast<InternalNode *>(node);
+            InternalNode *next_internal = static_cast<InternalNode *>(next);
+            for (; count > 0; count--) {
+                internal->insert_at(internal->size, parent->take_key(ind), next_internal->children[0]);
+                parent->set_key(ind, next_internal->take_key(0));
+                next_internal->pop_front();
+            }
+        }
+        parent->refresh_child(ind);
+        parent->refresh_child(ind + 1);
+    }
+
+    // merges the children around the separator 'ind' of 'parent' into the left one
+    void merge_node(InternalNode *parent, std::size_t ind) {
+        Node *left  = parent->children[ind];
+        Node *right = parent->children[ind + 1];
+        if (left->is_leaf) {
+            static_cast<LeafNode *>(left)->merge(static_cast<LeafNode *>(right));
+            if (right == last_node) {
+                last_node = static_cast<LeafNode *>(left);
+            }
+        } else {
+            static_cast<InternalNode *>(left)->merge(static_cast<InternalNode *>(right), parent->take_key(ind));
+        }
+        parent->delete_by_ind(ind);
+        parent->refresh_child(ind);
+        delete_node(right);
+    }
+
+    // fills the underfull child 'ind' of 'parent' up to the minimum from a sibling or merges it with one
+    void repair(InternalNode *parent, const std::size_t ind) {
+        Node *node = parent->children[ind];
+        Node *prev = ind > 0 ? parent->children[ind - 1] : nullptr;
+        Node *next = ind < parent->size ? parent->children[ind + 1] : nullptr;
+        if (node->is_leaf) {
+            if (prev != nullptr && node->size < leaf_min && prev->size > leaf_min) {
+                borrow_from_prev(parent, ind, std::min(leaf_min - node->size, prev->size - leaf_min));
+            }
+            if (next != nullptr && node->size < leaf_min && next->size > leaf_min) {
+                borrow_from_next(parent, ind, std::min(leaf_min - node->size, next->size - leaf_min));
+            }
+            if (node->size < leaf_min && parent->size > 0) {
+                merge_node(parent, prev != nullptr ? ind - 1 : ind);
+            }
+            return;
+        }
+        // the keys of internal nodes move one at a time, since the minimum of packed separators depends on their
+        // length as well
+        InternalNode *internal      = static_cast<InternalNode *>(node);
+        InternalNode *prev_internal = static_cast<InternalNode *>(prev);
+        InternalNode *next_internal = static_cast<InternalNode *>(next);
+        while (prev != nullptr && internal->thin() && prev_internal->can_lend(false)) {
+            borrow_from_prev(parent, ind, 1);
+        }
+        while (next != nullptr && internal->thin() && next_internal->can_lend(true)) {
+            borrow_from_next(parent, ind, 1);
+        }
+        if (!internal->thin() || parent->size == 0) {
+            return;
+        }
+        const std::size_t left = prev != nullptr ? ind - 1 : ind;
+        InternalNode *first    = static_cast<InternalNode *>(parent->children[left]);
+        InternalNode *second   = static_cast<InternalNode *>(parent->children[left + 1]);
+        InternalNode *sibling  = prev != nullptr ? prev_internal : next_internal;
+        // if the two take more characters than a node has, the sibling fills this one even though it gets thin
+        // itself; one with a single key has none to spare, so they merge all the same and spill to the heap
+        if (sibling->size < 2 || first->can_merge(second, parent, left)) {
+            merge_node(parent, left);
+            return;
+        }
+        while (internal->thin() && sibling->size > 1) {
+            if (prev != nullptr) {
+                borrow_from_prev(parent, ind, 1);
+            } else {
+                borrow_from_next(parent, ind, 1);
+            }
         }
     }
 
-private:
-    void copy(const BPTree<Key, Value, BlockSize, Less> &prototype) {
-        clear();
-        root = new Node(*prototype.root);
-        std::vector<Node *> leafs;
-        std::queue<Node *> q;
-        q.push(root);
-        while (!q.empty()) {
-            Node *top = q.front();
-            q.pop();
-            if (top->is_leaf) {
-                leafs.push_back(top);
+    // an empty root leaf leaves the tree empty, an internal root with a single child hands the root over to it
+    void shrink_root() {
+        while (root != nullptr && root->size == 0) {
+            Node *old = root;
+            if (root->is_leaf) {
+                root       = nullptr;
+                first_node = nullptr;
+                last_node  = nullptr;
             } else {
-                for (std::size_t i = 0; i < top->size + 1; i++) {
-                    q.push(top->children[i]);
-                }
+                root = static_cast<InternalNode *>(root)->children[0];
             }
+            delete_node(old);
         }
-        first_node              = leafs[0];
-        first_node->children[0] = nullptr;
-        for (std::size_t i = 1; i < leafs.size(); i++) {
-            leafs[i - 1]->children[1] = leafs[i];
-            leafs[i]->children[0]     = leafs[i - 1];
-        }
-        leafs[leafs.size() - 1]->children[1] = nullptr;
-        tree_size                            = prototype.tree_size;
-    }
-    void move_source(BPTree &&prototype) {
-        clear();
-        std::swap(root, prototype.root);
-        std::swap(first_node, prototype.first_node);
-        std::swap(tree_size, prototype.tree_size);
     }
 
-public:
-    BPTree(const BPTree<Key, Value, BlockSize, Less> &prototype) { copy(prototype); }
-
-    BPTree(BPTree &&prototype) { move_source(std::move(prototype)); }
-
-    iterator begin() {
-        iterator begin = iterator(first_node);
-        return begin;
+    // repairs the thin nodes on the way up from 'node', the end of 'path': a single erase stops at the first node that
+    // is not thin, 'whole' goes on up to the root; returns whether anything was repaired
+    bool rebalance(Path &path, Node *node, const bool whole) {
+        bool changed = false;
+        for (; !path.empty() && (whole || thin(node)); path.pop_back()) {
+            InternalNode *parent = path.back().first;
+            if (thin(node) && parent->size > 0) {
+                repair(parent, path.back().second);
+                changed = true;
+            }
+            node = parent;
+        }
+        shrink_root();
+        return changed;
     }
 
-    const_iterator cbegin() const { return const_iterator(first_node); }
-
-    const_iterator begin() const { return cbegin(); }
-
-    iterator end() { return iterator(nullptr); }
-
-    const_iterator cend() const { return const_iterator(nullptr); }
-
-    const_iterator end() const { return cend(); }
-
-    bool empty() const { return root == nullptr; }
-
-    size_type size() const { return tree_size; }
-
-    ~BPTree() { clear(); }
-
-    void clear() {
-        tree_size = 0;
-        delete root;
-        root       = nullptr;
-        first_node = nullptr;
+    // frees a subtree cut off the tree, returns the number of elements it held
+    std::size_t free_subtree(Node *node) {
+        std::size_t count = node->size;
+        if (!node->is_leaf) {
+            InternalNode *internal = static_cast<InternalNode *>(node);
+            count                  = 0;
+            for (std::size_t i = 0; i <= internal->size; i++) {
+                count += free_subtree(internal->children[i]);
+            }
+        }
+        delete_node(node);
+        return count;
     }
 
-    size_type count(const Key &key) const { return contains(key); }
-
-    bool contains(const Key &key) const {
-        node_type *tmp = find_leaf(key);
-        return tmp != nullptr && tmp->getIndex(key) != neutral;
+    // cuts every subtree strictly between the leaves at the ends of 'left' and 'right' (an empty path stands for the
+    // edge of the tree): the two paths go up together until they meet, dropping the children beyond them on each
+    // level, and 'right' is moved along with its nodes
+    void cut_between(const Path &left, Path &right) {
+        for (std::size_t level = std::max(left.size(), right.size()); level-- > 0;) {
+            if (!left.empty() && !right.empty() && left[level].first == right[level].first) {
+                drop_children(left[level].first, left[level].second + 1, right[level].second);
+                right[level].second = left[level].second + 1;
+                return;
+            }
+            if (!left.empty()) {
+                drop_children(left[level].first, left[level].second + 1, left[level].first->size + 1);
+            }
+            if (!right.empty()) {
+                drop_children(right[level].first, 0, right[level].second);
+                right[level].second = 0;
+            }
+        }
     }
 
-    std::pair<iterator, iterator> equal_range(const Key &key) {
-        iterator start  = lower_bound(key);
-        iterator finish = start;
-        if (start != end()) {
-            finish++;
+    void drop_children(InternalNode *node, std::size_t from, std::size_t to) {
+        if (from >= to) {
+            return;
         }
-        return {start, finish};
+        for (std::size_t i = from; i < to; i++) {
+            tree_size -= free_subtree(node->children[i]);
+        }
+        node->delete_children(from, to);
     }
 
-    std::pair<const_iterator, const_iterator> equal_range(const Key &key) const {
-        const_iterator start  = lower_bound(key);
-        const_iterator finish = start;
-        if (start != end()) {
-            finish++;
+    // removes [from, to) of 'first' through 'to' of 'last' ('last' is null for the end of the tree): the leaves and
+    // subtrees in between are cut off whole, the boundary leaves are trimmed, and then only the nodes on the two
+    // boundary paths are rebalanced, one path after the other, as many times as a merge above gives a thin node new
+    // siblings. A key kept in each boundary leaf finds its path again after every change
+    void erase_range(LeafNode *first, std::size_t from, LeafNode *last, std::size_t to) {
+        if (first == last) {
+            Path path;
+            descend(path, first->slots[0].first);
+            first->delete_range(from, to);
+            tree_size -= to - from;
+            refresh_path(path);
+            rebalance(path, first, false);
+            return;
+        }
+        LeafNode *left  = from > 0 ? first : first->prev;
+        LeafNode *right = last;
+        if (left == nullptr && right == nullptr) {
+            clear();
+            return;
+        }
+        std::vector<Key> bounds;
+        Path left_path, right_path;
+        if (left != nullptr) {
+            bounds.push_back(left->slots[0].first);
+            descend(left_path, bounds.back());
+        }
+        if (right != nullptr) {
+            bounds.push_back(right->slots[to].first);
+            descend(right_path, bounds.back());
+        }
+        if (from > 0) {
+            tree_size -= first->size - from;
+            first->delete_range(from, first->size);
+        }
+        if (right != nullptr) {
+            tree_size -= to;
+            right->delete_range(0, to);
+        }
+        cut_between(left_path, right_path);
+        if (left != nullptr) {
+            left->next = right;
+        } else {
+            first_node = right;
+        }
+        if (right != nullptr) {
+            right->prev = left;
+        } else {
+            last_node = left;
+        }
+        refresh_path(left_path);
+        refresh_path(right_path);
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (const Key &bound : bounds) {
+                Path path;
+                LeafNode *leaf = descend(path, bound);
+                changed        = rebalance(path, leaf, true) || changed;
+            }
         }
-        return {start, finish};
     }
 
-    iterator lower_bound(const Key &key) {
-        std::pair<node_type *, std::size_t> tmp = tree_lower_bound(key);
-        return iterator(tmp.first, tmp.second);
+    void erase(Path &path, LeafNode *leaf, std::size_t delete_ind) {
+        leaf->delete_by_ind(delete_ind);
+        tree_size--;
+        refresh_path(path);
+        rebalance(path, leaf, false);
     }
 
-    const_iterator lower_bound(const Key &key) const {
-        std::pair<node_type *, std::size_t> tmp = tree_lower_bound(key);
-        return const_iterator(tmp.first, tmp.second);
+public:
+    iterator erase(const_iterator source) {
+        if (source == end()) {
+            return end();
+        }
+        const key_type source_key = source->first;
+        Path path;
+        LeafNode *leaf = descend(path, source_key);
+        erase(path, leaf, leaf->getIndex(source_key));
+        return upper_bound(source_key);
     }
 
-    iterator upper_bound(const Key &key) {
-        std::pair<node_type *, std::size_t> tmp = tree_upper_bound(key);
-        return iterator(tmp.first, tmp.second);
+    iterator erase(const_iterator start, const_iterator finish) {
+        if (start == finish) {
+            return make_iterator(finish.leaf, finish.ind);
+        }
+        if (finish == end()) {
+            erase_range(start.leaf, start.ind, nullptr, 0);
+            return end();
+        }
+        const Key finish_key = finish->first;
+        erase_range(start.leaf, start.ind, finish.leaf, finish.ind);
+        return lower_bound(finish_key);
     }
 
-    const_iterator upper_bound(const Key &key) const {
-        std::pair<node_type *, std::size_t> tmp = tree_upper_bound(key);
-        return const_iterator(tmp.first, tmp.second);
+    size_type erase(const Key &key) {
+        if (empty()) {
+            return 0;
+        }
+        Path path;
+        LeafNode *leaf        = descend(path, key);
+        const std::size_t ind = leaf->getIndex(key);
+        if (ind == neutral) {
+            return 0;
+        }
+        erase(path, leaf, ind);
+        return 1;
     }
 
-    iterator find(const Key &key) {
-        std::pair<node_type *, std::size_t> tmp = tree_find(key);
-        if (tmp.first == nullptr) {
-            return end();
+private:
+    NodeAllocator allocator;
+    Node *root           = nullptr;
+    LeafNode *first_node = nullptr;
+    LeafNode *last_node  = nullptr;
+    size_type tree_size  = 0;
+    // the last new key of the rightmost leaf went to its end or came with end() as its hint, see emplace_key
+    bool appending = false;
+
+    // a leaf is touched one cache line after another while it is scanned, so all of them are requested at once
+    static void prefetch_node(const LeafNode *leaf) {
+#if defined(__GNUC__)
+        if (leaf == nullptr) {
+            return;
         }
-        return iterator(tmp.first, tmp.second);
+        const char *block = reinterpret_cast<const char *>(leaf);
+        for (std::size_t offset = 0; offset < sizeof(LeafNode); offset += 64) {
+            __builtin_prefetch(block + offset);
+        }
+#else
+        (void)leaf;
+#endif
     }
 
-    const_iterator find(const Key &key) const {
-        std::pair<node_type *, std::size_t> tmp = tree_find(key);
-        if (tmp.first == nullptr) {
-            return end();
+    iterator make_iterator(LeafNode *leaf, std::size_t ind) const { return iterator(leaf, ind, last_node); }
+
+    value_reference value_at(iterator it) {
+        if constexpr (aggregated) {
+            return ValueProxy(this, it);
+        } else {
+            return it->second;
         }
-        return const_iterator(tmp.first, tmp.second);
     }
 
-    BPTree<Key, Value, BlockSize, Less> &operator=(BPTree<Key, Value, BlockSize, Less> &&source) {
-        move_source(std::move(source));
-        return *this;
+    // end() stands for the rightmost leaf and tells that the key is appended
+    LeafNode *hint_leaf(const_iterator hint) {
+        if (hint.leaf != nullptr) {
+            return hint.leaf;
+        }
+        appending = true;
+        return last_node;
     }
 
-    BPTree<Key, Value, BlockSize, Less> &operator=(const BPTree<Key, Value, BlockSize, Less> &source) {
-        copy(source);
-        return *this;
+    // 'key' may go to 'leaf' without a descent if it is within the keys of the leaf or beyond the rightmost one
+    static bool fits(const LeafNode *leaf, const Key &key) {
+        return leaf != nullptr && leaf->size > 0 && check<Compare::greater_equal>(key, leaf->slots[0].first) &&
+               (leaf->next == nullptr || check<Compare::less_equal>(key, leaf->slots[leaf->size - 1].first));
     }
 
-    // 'at' method throws std::out_of_range if there is no such key
-    Value &at(const Key &key) {
-        iterator tmp = find(key);
-        if (tmp == end()) {
-            throw std::out_of_range("Incorrect key");
+    // the key that goes up between two neighbouring nodes only has to be not less than 'left', the last key of the
+    // left one, and less than 'right', the first key of the right one. Strings get the shortest such prefix of 'right',
+    // so the packed separators of an internal node (see NodeKeys) are short and more of them fit inline
+    static Key separator(const Key &left, const Key &right) {
+        if constexpr (truncated) {
+            const std::size_t common =
+                std::mismatch(left.begin(), left.end(), right.begin(), right.end()).first - left.begin();
+            if (common + 1 < right.size()) {
+                return right.substr(0, common + 1);
+            }
         }
-        return (tmp->second);
+        return left;
     }
 
-    const Value &at(const Key &key) const {
-        const_iterator tmp = find(key);
-        if (tmp == end()) {
-            throw std::out_of_range("Incorrect key");
+    // the same for the subtree 'right', whose first key is in its leftmost leaf
+    static Key separator(const Key &left, const Node *right) {
+        if constexpr (truncated) {
+            while (!right->is_leaf) {
+                right = static_cast<const InternalNode *>(right)->children[0];
+            }
+            return separator(left, static_cast<const LeafNode *>(right)->slots[0].first);
         }
-        return (find(key)->second);
+        return left;
     }
 
-    // '[]' operator inserts a new element if there is no such key
-    Value &operator[](const Key &key) {
-        const_iterator tmp = find(key);
-        if (tmp == end()) {
-            insert_to_tree(key, defaultValue);
-        }
-        return (find(key)->second);
+    // appends to the rightmost leaf keep 90% of the node and pass on the rest, so a monotonic ingest leaves the
+    // nodes nearly full instead of half empty
+    static constexpr std::size_t leaf_split(const bool append) {
+        return append ? leaf_size - leaf_size / 10 : (leaf_size + 2) / 2;
     }
 
-    std::pair<iterator, bool> insert(const Key &key, const Value &value) {
-        bool add = find(key) == end();
-        insert_to_tree(key, value);
-        return {find(key), add};
+    static constexpr std::size_t internal_split(const bool append) {
+        return append && internal_size >= 10 ? internal_size - internal_size / 10 : (internal_size + 1) / 2;
     }
 
-    std::pair<iterator, bool> insert(const Key &key, Value &&value) {
-        bool add = find(key) == end();
-        insert_to_tree(key, std::forward<Value &&>(value));
-        return {find(key), add};
-    }
+    static void assign_value(Value &target) { target = Value(); }
 
-    // NB: a digression from std::map
-    template <class ForwardIt>
-    void insert(ForwardIt begin, ForwardIt end) {
-        ForwardIt element = begin;
-        while (element != end) {
-            insert_to_tree(element->first, element->second);
-            element++;
+    template <class Arg>
+    static void assign_value(Value &target, Arg &&arg) {
+        if constexpr (std::is_assignable_v<Value &, Arg &&>) {
+            target = std::forward<Arg>(arg);
+        } else {
+            target = Value(std::forward<Arg>(arg));
         }
     }
 
-    void insert(std::initializer_list<std::pair<Key, Value>> list) {
-        for (auto element : list) {
-            insert_to_tree(element.first, element.second);
-        }
+    template <class First, class Second, class... Args>
+    static void assign_value(Value &target, First &&first, Second &&second, Args &&...args) {
+        target = Value(std::forward<First>(first), std::forward<Second>(second), std::forward<Args>(args)...);
     }
 
-private:
-    Node *getPrev(Node *node) {
-        int h      = 0;
-        Node *curr = node->parent;
-        Node *tmp  = node;
-        if (node->is_leaf) {
-            return node->children[0];
-        }
-        while (curr != nullptr) {
-            std::size_t ind = curr->getChildrenByNode(tmp);
-            if (ind != 0) {
-                Node *prev = curr->children[ind - 1];
-                while (h--) {
-                    prev = prev->children[prev->size];
+    // one descent finds the slot of 'key' unless it fits the 'hint' leaf or the rightmost one; a new key gets a slot
+    // of its own and the value is assigned right there, an existing one gets 'args' only if 'assign' is set. The path
+    // to the leaf is needed only for a split or for the summaries, a leaf found without a descent gets it then. A full
+    // rightmost leaf is split 90/10 only within a run of appends to it, a single key past the end splits it in halves
+    template <class K, class... Args>
+    std::pair<iterator, bool> emplace_key(LeafNode *hint, const bool assign, K &&key, Args &&...args) {
+        if constexpr (!std::is_same_v<std::decay_t<K>, Key>) {
+            return emplace_key(hint, assign, Key(std::forward<K>(key)), std::forward<Args>(args)...);
+        } else {
+            if (root == nullptr) {
+                LeafNode *leaf = create<LeafNode>();
+                root           = leaf;
+                first_node     = leaf;
+                last_node      = leaf;
+            }
+            Path path;
+            const auto trace = [&]() -> Path & {
+                if (path.empty()) {
+                    descend(path, key);
+                }
+                return path;
+            };
+            LeafNode *leaf  = fits(hint, key) ? hint : fits(last_node, key) ? last_node : descend(path, key);
+            std::size_t ind = leaf->getChildIndex(key);
+            if (ind < leaf->size && check<Compare::greater_equal>(key, leaf->slots[ind].first)) {
+                if (assign) {
+                    assign_value(leaf->slots[ind].second, std::forward<Args>(args)...);
+                    if constexpr (aggregated) {
+                        refresh_path(trace());
+                    }
+                }
+                return {make_iterator(leaf, ind), false};
+            }
+            const bool append = leaf == last_node && ind == leaf->size && appending;
+            if (leaf == last_node) {
+                appending = ind == leaf->size;
+            }
+            if (leaf->size < leaf_size) {
+                if constexpr (summarized) {
+                    trace();
                 }
-                return prev;
+                leaf->make_room(ind);
+                leaf->slots[ind].first = std::forward<K>(key);
+                assign_value(leaf->slots[ind].second, std::forward<Args>(args)...);
+                tree_size++;
+                refresh_path(path);
+                return {make_iterator(leaf, ind), true};
+            }
+            trace();
+            LeafNode *right          = create<LeafNode>();
+            LeafNode *target         = leaf->split_node(right, ind, leaf_split(append));
+            target->slots[ind].first = std::forward<K>(key);
+            assign_value(target->slots[ind].second, std::forward<Args>(args)...);
+            tree_size++;
+            if (leaf == last_node) {
+                last_node = right;
             }
-            tmp  = curr;
-            curr = curr->parent;
-            h++;
+            add_to_parent(path, leaf, separator(leaf->slots[leaf->size - 1].first, right->slots[0].first), right,
+                          append);
+            return {make_iterator(target, ind), true};
         }
-        return nullptr;
     }
 
-    Node *getNext(Node *node) {
-        int h      = 0;
-        Node *curr = node->parent;
-        Node *tmp  = node;
-        if (node->is_leaf) {
-            return node->children[1];
+    // links 'right' into the tree right after 'left', the end of 'path', and 'key' separates them; 'append' tells that
+    // 'right' is the new rightmost node of an ingest of increasing keys. The path is used up on the way
+    template <class forward_type>
+    void add_to_parent(Path &path, Node *left, forward_type &&key, Node *right, const bool append) {
+        if (path.empty()) {
+            InternalNode *parent = create<InternalNode>();
+            parent->put_child(0, left);
+            parent->insert_at(0, std::forward<forward_type>(key), right);
+            root = parent;
+            return;
         }
-        while (curr != nullptr) {
-            std::size_t ind = curr->getChildrenByNode(tmp);
-            if (ind != curr->size) {
-                Node *next = curr->children[ind + 1];
-                while (h--) {
-                    next = next->children[0];
-                }
-                return next;
+        const auto [parent, ind] = path.back();
+        path.pop_back();
+        parent->refresh_child(ind);
+        if (parent->has_room(key)) {
+            parent->insert_at(ind, std::forward<forward_type>(key), right);
+            refresh_path(path);
+            return;
+        }
+        InternalNode *sibling = create<InternalNode>();
+        const std::size_t mid = parent->split_point(ind, key, internal_split(append));
+        Key up                = parent->split_node(sibling, ind, std::forward<forward_type>(key), right, mid);
+        add_to_parent(path, parent, std::move(up), sibling, append);
+    }
+
+    // a node that changed during a batched insert: its place in the tree, the nodes that go right after it in the
+    // parent together with the separators before them, and whether it is the rightmost node of an append
+    struct Growth {
+        Path path;
+        std::vector<std::pair<Key, Node *>> siblings;
+        bool append;
+    };
+
+    // the step of 'path' whose key ends the range of the leaf at its end, null for the rightmost leaf
+    static const typename Path::value_type *fence(const Path &path) {
+        for (auto step = path.rbegin(); step != path.rend(); ++step) {
+            if (step->second < step->first->size) {
+                return &*step;
             }
-            tmp  = curr;
-            curr = curr->parent;
-            h++;
         }
         return nullptr;
     }
 
-    void upd_parent(Node *node) {
-        while (!node->is_leaf) {
-            node = node->children[node->size];
+    // sizes of the nodes that share 'count' items, one node if it can hold them: otherwise the items are spread
+    // evenly, except for an append, which fills the nodes as far as the single inserts do and passes the rest on
+    static std::vector<std::size_t> cut(const std::size_t count, const std::size_t capacity, const std::size_t minimum,
+                                        const std::size_t spare, const std::size_t append_fill, const bool append) {
+        if (count <= capacity + spare) {
+            return {count};
         }
-        value_type element;
-        if (node->size != 0) {
-            element = node->keys[node->size - 1];
-        } else if (node->children[0] != nullptr) {
-            Node *prev = node->children[0];
-            element    = prev->keys[prev->size - 1];
+        if (append) {
+            return plan(count, static_cast<double>(append_fill) / capacity, capacity, minimum, spare);
         }
-        Node *curr = node->parent;
-        Node *tmp  = node;
-        while (curr != nullptr) {
-            std::size_t ind = curr->getChildrenByNode(tmp);
-            if (ind != curr->size) {
-                curr->keys[ind] = element;
-                break;
-            }
-            tmp  = curr;
-            curr = curr->parent;
+        const std::size_t parts = (count + capacity + spare - 1) / (capacity + spare);
+        std::vector<std::size_t> sizes(parts);
+        for (std::size_t i = 0; i < parts; i++) {
+            sizes[i] = count * (i + 1) / parts - count * i / parts;
         }
+        return sizes;
     }
 
-    void merge_node(Node *left, Node *right) {
-        if (left == first_node) {
-            first_node = right;
+    // merges every run of the sorted 'batch' into its leaf, one descent per leaf: in place if the leaf has room for the
+    // new keys, through a buffer cut into several leaves otherwise; returns the leaves that got new siblings, or every
+    // changed leaf if the tree keeps summaries
+    std::vector<Growth> merge_runs(std::vector<value_type> &batch) {
+        const auto before = [](const typename Path::value_type &bound, const value_type &element) {
+            return bound.first->template check_key<Compare::less>(bound.second, element.first);
+        };
+        std::vector<Growth> grown;
+        std::vector<value_type> merged;
+        Path path;
+        for (auto run = batch.begin(); run != batch.end();) {
+            LeafNode *leaf   = descend(path, run->first);
+            const auto *bound = fence(path);
+            const auto stop   = bound != nullptr ? std::upper_bound(run, batch.end(), *bound, before) : batch.end();
+
+            const std::size_t size = leaf->size;
+            const bool append      = leaf == last_node &&
+                                     (size == 0 || check<Compare::greater>(run->first, leaf->slots[size - 1].first));
+            std::size_t fresh = 0;
+            for (auto element = run; element != stop; ++element) {
+                fresh += leaf->getIndex(element->first) == neutral;
+            }
+            tree_size += fresh;
+            if (size + fresh <= leaf_size) {
+                leaf->merge_run(run, stop, fresh);
+                if constexpr (summarized) {
+                    grown.push_back(Growth{path, {}, append});
+                }
+                run = stop;
+                continue;
+            }
+            std::size_t ind = 0;
+            merged.clear();
+            for (; run != stop; ++run) {
+                for (; ind < size && check<Compare::less>(leaf->slots[ind].first, run->first); ind++) {
+                    merged.push_back(std::move(leaf->slots[ind]));
+                }
+                if (ind < size && check<Compare::equal>(leaf->slots[ind].first, run->first)) {
+                    leaf->slots[ind].second = std::move(run->second);
+                    merged.push_back(std::move(leaf->slots[ind++]));
+                } else {
+                    merged.push_back(std::move(*run));
+                }
+            }
+            for (; ind < size; ind++) {
+                merged.push_back(std::move(leaf->slots[ind]));
+            }
+            Growth growth{path, {}, append};
+            LeafNode *node = leaf;
+            auto element   = merged.begin();
+            for (const std::size_t count : cut(merged.size(), leaf_size, leaf_min, 0, leaf_split(true), append)) {
+                if (element != merged.begin()) {
+                    LeafNode *next = create<LeafNode>();
+                    next->link_after(node);
+                    growth.siblings.emplace_back(separator(node->slots[node->size - 1].first, element->first), next);
+                    node = next;
+                }
+                std::move(element, element + count, node->slots);
+                node->size = count;
+                element += count;
+            }
+            for (std::size_t i = leaf->size; i < size; i++) {
+                leaf->slots[i] = value_type();
+            }
+            if (leaf == last_node) {
+                last_node = node;
+            }
+            if (summarized || !growth.siblings.empty()) {
+                grown.push_back(std::move(growth));
+            }
         }
-        std::size_t delete_ind  = left->parent->getChildrenByNode(left);
-        value_type move_element = left->parent->keys[delete_ind];
-        erase(left->parent, delete_ind);
-        right->merge(left, move_element);
-        upd_parent(right);
-        left->clear();
+        return grown;
     }
 
-    void erase(Node *node, const std::size_t &delete_ind) {
-        if (tree_size == 0) {
-            clear();
-            return;
+    // rebuilds 'parent' with the siblings of the children that grew right after them, the children being those of
+    // level[start, finish); a parent that overflows is cut into as many nodes as it needs, the new ones are returned
+    std::vector<std::pair<Key, Node *>> rebuild(InternalNode *parent, std::vector<Growth> &level, std::size_t start,
+                                                const std::size_t finish) {
+        std::vector<Key> keys;
+        std::vector<Node *> children;
+        for (std::size_t i = 0; i <= parent->size; i++) {
+            children.push_back(parent->children[i]);
+            if (start < finish && level[start].path.back().second == i) {
+                for (std::pair<Key, Node *> &sibling : level[start].siblings) {
+                    keys.push_back(std::move(sibling.first));
+                    children.push_back(sibling.second);
+                }
+                start++;
+            }
+            if (i < parent->size) {
+                keys.push_back(parent->take_key(i));
+            }
         }
-        node->delete_by_ind(delete_ind);
-        if (node->size < max_size / 2) {
-            Node *prev = getPrev(node);
-            Node *next = getNext(node);
-            if (prev != nullptr && prev->size > max_size / 2) {
-                Node *child1 = nullptr;
-                Node *child2 = nullptr;
-                if (!node->is_leaf) {
-                    child1 = prev->children[prev->size];
-                    child2 = node->children[0];
-                }
-                value_type move_element = prev->keys[prev->size - 1];
-                erase(prev, prev->size - std::size_t(prev->is_leaf));
-                node->add_element(move_element.first, move_element.second, child1, child2);
-                if (!node->is_leaf) {
-                    upd_parent(node->children[0]);
-                }
-                upd_parent(node);
-            } else if (next != nullptr && next->size > max_size / 2) {
-                Node *child1 = nullptr;
-                Node *child2 = nullptr;
-                if (!node->is_leaf) {
-                    child1 = node->children[node->size];
-                    child2 = next->children[0];
-                }
-                value_type move_element = next->keys[0];
-                erase(next, 0);
-                node->add_element(move_element.first, move_element.second, child1, child2);
-                upd_parent(node);
-            } else if (prev != nullptr && prev->parent == node->parent) {
-                merge_node(prev, node);
-            } else if (next != nullptr && next->parent == node->parent) {
-                merge_node(node, next);
-            } else {
-                if (node->size == 0) {
-                    if (root == node) {
-                        root                      = node->children[0];
-                        node->children[0]->parent = nullptr;
+        const std::size_t size = parent->size;
+        const bool append      = level[finish - 1].append;
+        std::vector<std::pair<Key, Node *>> siblings;
+        InternalNode *node = parent;
+        std::size_t child  = 0;
+        const std::vector<std::size_t> sizes =
+            refine(cut(children.size(), internal_size, internal_min, 1, internal_split(true), append),
+                   [&keys](const std::size_t child) -> const Key & { return keys[child - 1]; });
+        for (const std::size_t count : sizes) {
+            if (child != 0) {
+                node = create<InternalNode>();
+                siblings.emplace_back(std::move(keys[child - 1]), node);
+            }
+            node->keys.truncate(node->size, 0);
+            node->size = 0;
+            node->put_child(0, children[child]);
+            for (std::size_t i = 1; i < count; i++) {
+                node->insert_at(i - 1, std::move(keys[child + i - 1]), children[child + i]);
+            }
+            child += count;
+        }
+        for (std::size_t i = parent->size + 1; i <= size; i++) {
+            parent->children[i] = nullptr;
+        }
+        return siblings;
+    }
+
+    // puts the new siblings of the nodes of one level into their parents, a parent at a time, and goes on with the
+    // parents that grew in turn until the root; a root that grows gets a new root above it
+    void grow(std::vector<Growth> level) {
+        while (!level.empty()) {
+            if (level[0].path.empty()) {
+                if (level[0].siblings.empty()) {
+                    return;
+                }
+                InternalNode *top = create<InternalNode>();
+                top->put_child(0, root);
+                root = top;
+                level[0].path.emplace_back(top, 0);
+            }
+            std::vector<Growth> parents;
+            for (std::size_t start = 0, finish = 0; start < level.size(); start = finish) {
+                InternalNode *parent = level[start].path.back().first;
+                bool grew            = false;
+                for (finish = start; finish < level.size() && level[finish].path.back().first == parent; finish++) {
+                    grew = grew || !level[finish].siblings.empty();
+                }
+                std::vector<std::pair<Key, Node *>> siblings;
+                if (grew) {
+                    siblings = rebuild(parent, level, start, finish);
+                } else if constexpr (summarized) {
+                    for (std::size_t i = start; i < finish; i++) {
+                        parent->refresh_child(level[i].path.back().second);
                     }
-                    node->clear();
+                }
+                if (summarized || !siblings.empty()) {
+                    Growth growth{std::move(level[start].path), std::move(siblings), level[finish - 1].append};
+                    growth.path.pop_back();
+                    parents.push_back(std::move(growth));
                 }
             }
-        } else {
-            upd_parent(node);
+            level.swap(parents);
         }
     }
 
-public:
-    iterator erase(const_iterator source) {
-        if (source == end()) {
-            return end();
+    template <class K>
+    LeafNode *find_leaf(const K &key) const {
+        Node *tmp = root;
+        while (tmp != nullptr) {
+            if (tmp->is_leaf) {
+                return static_cast<LeafNode *>(tmp);
+            }
+            InternalNode *node = static_cast<InternalNode *>(tmp);
+            tmp                = node->children[node->getChildIndex(key)];
         }
-        tree_size--;
-        node_type *leaf           = find_leaf(source->first);
-        const key_type source_key = source->first;
-        erase(leaf, leaf->getIndex(source_key));
-        return upper_bound(source_key);
+        return nullptr;
     }
 
-    iterator erase(const_iterator start, const_iterator finish) {
-        std::vector<Key> v;
-        while (start != finish) {
-            v.push_back(start->first);
-            start++;
-        }
-        const Key res_key = finish->first;
-        for (std::size_t i = 0; i < v.size(); i++) {
-            erase(v[i]);
+    // the number of keys of a batch that descend together
+    static constexpr std::size_t batch_lanes = 16;
+
+    // calls 'emit(key, leaf)' with the leaf of every key of [first, last) in turn
+    template <class ForwardIt, class Emit>
+    void find_leaves(ForwardIt first, ForwardIt last, Emit emit) const {
+        if (root == nullptr) {
+            for (; first != last; ++first) {
+                emit(*first, nullptr);
+            }
+        } else if (std::is_sorted(first, last, [](const Key &a, const Key &b) { return check<Compare::less>(a, b); })) {
+            find_sorted_leaves(first, last, emit);
+        } else {
+            find_interleaved_leaves(first, last, emit);
         }
-        v.clear();
-        return find(res_key);
     }
 
-    size_type erase(const Key &key) {
-        const_iterator it = find(key);
-        if (it == end()) {
-            return 0;
+    // the path to the leaf of the last key is kept, and every key climbs it only as far as descend() would: the keys
+    // that stay in that leaf take no step, the others go down from the lowest node of the path that covers them, up
+    // to batch_lanes of them interleaved, and the path follows the last of them down
+    template <class ForwardIt, class Emit>
+    void find_sorted_leaves(ForwardIt first, ForwardIt last, Emit emit) const {
+        Path path;
+        ForwardIt keys[batch_lanes];
+        Node *nodes[batch_lanes];
+        while (first != last) {
+            std::size_t lanes = 0;
+            std::size_t keep  = path.size();
+            for (; lanes < batch_lanes && first != last; ++lanes, ++first) {
+                while (keep > 0 && beyond(path[keep - 1], *first)) {
+                    keep--;
+                }
+                keys[lanes]  = first;
+                nodes[lanes] = keep > 0 ? path[keep - 1].first->children[path[keep - 1].second] : root;
+            }
+            path.resize(keep);
+            for (bool deeper = true; deeper;) {
+                deeper = false;
+                for (std::size_t i = 0; i < lanes; i++) {
+                    if (nodes[i]->is_leaf) {
+                        continue;
+                    }
+                    InternalNode *internal = static_cast<InternalNode *>(nodes[i]);
+                    const std::size_t ind  = internal->getChildIndex(*keys[i]);
+                    if (i + 1 == lanes) {
+                        path.emplace_back(internal, ind);
+                    }
+                    nodes[i] = internal->children[ind];
+                    prefetch_search(nodes[i]);
+                    deeper = true;
+                }
+            }
+            for (std::size_t i = 0; i < lanes; i++) {
+                emit(*keys[i], static_cast<LeafNode *>(nodes[i]));
+            }
         }
-        erase(it);
-        return 1;
     }
 
-private:
-    using node_type       = Node;
-    node_type *root       = nullptr;
-    node_type *first_node = nullptr;
-    Value defaultValue    = Value();
-    size_type tree_size   = 0;
+    // whether 'key' is past the child that 'step' of a path goes to: the range of a child ends at the key after it in
+    // the parent, that of the last child ends where the range of the parent does, so the step is left for it
+    static bool beyond(const typename Path::value_type &step, const Key &key) {
+        return step.second == step.first->size || step.first->template check_key<Compare::less>(step.second, key);
+    }
 
-    template <class forward_type>
-    void insert_to_tree(const Key &key, forward_type &&value) {
-        if (root == nullptr) {
-            root       = new node_type();
-            first_node = root;
+    // moves 'path' over to the leaf of 'key', which is not less than the key it was on
+    LeafNode *descend(Path &path, const Key &key) const {
+        while (!path.empty() && beyond(path.back(), key)) {
+            path.pop_back();
+        }
+        Node *node = path.empty() ? root : path.back().first->children[path.back().second];
+        while (!node->is_leaf) {
+            InternalNode *internal = static_cast<InternalNode *>(node);
+            path.emplace_back(internal, internal->getChildIndex(key));
+            node = internal->children[path.back().second];
+        }
+        return static_cast<LeafNode *>(node);
+    }
 
-            root->children[0] = nullptr;
-            root->children[1] = nullptr;
-            root->is_leaf     = true;
+    // group prefetching: every level is done for all the keys of a group before the next one
+    template <class ForwardIt, class Emit>
+    void find_interleaved_leaves(ForwardIt first, ForwardIt last, Emit emit) const {
+        ForwardIt keys[batch_lanes];
+        Node *nodes[batch_lanes];
+        while (first != last) {
+            std::size_t lanes = 0;
+            for (; lanes < batch_lanes && first != last; ++lanes, ++first) {
+                keys[lanes]  = first;
+                nodes[lanes] = root;
+            }
+            while (!nodes[0]->is_leaf) {
+                for (std::size_t i = 0; i < lanes; i++) {
+                    const InternalNode *internal = static_cast<const InternalNode *>(nodes[i]);
+                    nodes[i]                     = internal->children[internal->getChildIndex(*keys[i])];
+                    prefetch_search(nodes[i]);
+                }
+            }
+            for (std::size_t i = 0; i < lanes; i++) {
+                emit(*keys[i], static_cast<LeafNode *>(nodes[i]));
+            }
+        }
+    }
 
-            add_to_node(root, key, std::forward<forward_type>(value), nullptr, nullptr);
+    // a search in a node reads its header and then the middle of its keys first
+    static void prefetch_search(const Node *node) {
+#if defined(__GNUC__)
+        const char *block = reinterpret_cast<const char *>(node);
+        __builtin_prefetch(block);
+        __builtin_prefetch(block + BlockSize / 2);
+#else
+        (void)node;
+#endif
+    }
 
-            tree_size++;
-            return;
+    // the number of elements under 'node', taken from the counts of its children
+    static std::size_t subtree_size(const Node *node) {
+        if (node->is_leaf) {
+            return node->size;
+        }
+        const InternalNode *internal = static_cast<const InternalNode *>(node);
+        std::size_t count            = 0;
+        for (std::size_t i = 0; i <= internal->size; i++) {
+            count += internal->counts[i];
         }
-        node_type *leaf = find_leaf(key);
-        bool add        = add_to_node(leaf, key, std::forward<forward_type>(value), nullptr, nullptr);
-        tree_size += add;
+        return count;
     }
 
-    template <class forward_type>
-    bool add_to_node(node_type *node, const Key &key, forward_type &&value, node_type *child1, node_type *child2) {
-        bool add = node->add_element(key, std::forward<forward_type>(value), child1, child2);
-        if (max_size + 1 == node->size) {
-            node_type *node2  = node->split_node();
-            node_type *parent = node->parent;
-            if (parent == nullptr) {
-                parent = new node_type{};
-                root   = parent;
+    static aggregate_type subtree_aggregate(const Node *node) {
+        aggregate_type result = Aggregate::identity();
+        if (node->is_leaf) {
+            const LeafNode *leaf = static_cast<const LeafNode *>(node);
+            for (std::size_t i = 0; i < leaf->size; i++) {
+                result = Aggregate::combine(result, Aggregate::lift(leaf->slots[i].second));
+            }
+        } else {
+            const InternalNode *internal = static_cast<const InternalNode *>(node);
+            for (std::size_t i = 0; i <= internal->size; i++) {
+                result = Aggregate::combine(result, internal->aggregates[i]);
             }
-            add_to_node(parent, node->keys[node->size - node->is_leaf].first, std::move(Value()), node, node2);
-            return add;
         }
-        return add;
+        return result;
     }
 
-    node_type *find_leaf(const Key &key) const {
-        node_type *tmp = root;
-        while (tmp != nullptr) {
-            if (tmp->is_leaf) {
-                return tmp;
+    // folds the values of [lo, hi) under 'node', a bound that is off stands for the edge of the subtree; once the
+    // bounds part ways each of them follows a single path down, the subtrees between the paths give their cached
+    // aggregates
+    template <bool has_lo, bool has_hi>
+    static aggregate_type fold(const Node *node, const Key &lo, const Key &hi) {
+        if (node->is_leaf) {
+            const LeafNode *leaf   = static_cast<const LeafNode *>(node);
+            const std::size_t from = has_lo ? leaf->getChildIndex(lo) : 0;
+            const std::size_t to   = has_hi ? leaf->getChildIndex(hi) : leaf->size;
+            aggregate_type result  = Aggregate::identity();
+            for (std::size_t i = from; i < to; i++) {
+                result = Aggregate::combine(result, Aggregate::lift(leaf->slots[i].second));
             }
-            std::size_t ind = tmp->getChildIndex(key);
-            tmp             = tmp->children[ind];
+            return result;
         }
-        return nullptr;
+        const InternalNode *internal = static_cast<const InternalNode *>(node);
+        const std::size_t from       = has_lo ? internal->getChildIndex(lo) : 0;
+        const std::size_t to         = has_hi ? internal->getChildIndex(hi) : internal->size;
+        if (from == to) {
+            return fold<has_lo, has_hi>(internal->children[from], lo, hi);
+        }
+        aggregate_type result = fold<has_lo, false>(internal->children[from], lo, hi);
+        for (std::size_t i = from + 1; i < to; i++) {
+            result = Aggregate::combine(result, internal->aggregates[i]);
+        }
+        return Aggregate::combine(result, fold<false, has_hi>(internal->children[to], lo, hi));
     }
 
-    node_type *find_node(const Key &key) const {
-        node_type *tmp = root;
-        while (tmp != nullptr) {
-            if (tmp->is_leaf) {
-                return nullptr;
+    // brings the counts and aggregates on 'path' in line with the node at its end, from the bottom up
+    static void refresh_path(const Path &path) {
+        if constexpr (summarized) {
+            for (auto step = path.rbegin(); step != path.rend(); ++step) {
+                step->first->refresh_child(step->second);
             }
-            std::size_t ind = tmp->getIndex(key);
-            if (ind != neutral) {
-                return tmp;
+        }
+    }
+
+    // the leaf and the position of the element with 'k' elements before it, or null if there are too few of them
+    std::pair<LeafNode *, std::size_t> tree_select(std::size_t k) const {
+        static_assert(OrderStatistics, "order statistics need the OrderStatistics flag of the tree");
+        if (k >= tree_size) {
+            return {nullptr, 0};
+        }
+        Node *tmp = root;
+        while (!tmp->is_leaf) {
+            InternalNode *node = static_cast<InternalNode *>(tmp);
+            std::size_t ind    = 0;
+            for (; k >= node->counts[ind]; ind++) {
+                k -= node->counts[ind];
             }
-            ind = tmp->getChildIndex(key);
-            tmp = tmp->children[ind];
+            tmp = node->children[ind];
         }
-        return nullptr;
+        return {static_cast<LeafNode *>(tmp), k};
     }
 
-    std::pair<node_type *, std::size_t> tree_lower_bound(const Key &key) const {
-        node_type *tmp = find_leaf(key);
+    template <class K>
+    std::pair<LeafNode *, std::size_t> tree_lower_bound(const K &key) const {
+        LeafNode *tmp = find_leaf(key);
         if (tmp == nullptr) {
             return {nullptr, 0};
         }
         std::size_t ind = tmp->getChildIndex(key);
         if (ind >= tmp->size) {
-            return {tmp->children[1], 0};
+            return {tmp->next, 0};
         }
         return {tmp, ind};
     }
 
-    std::pair<node_type *, std::size_t> tree_upper_bound(const Key &key) const {
-        node_type *tmp = find_leaf(key);
+    template <class K>
+    std::pair<LeafNode *, std::size_t> tree_upper_bound(const K &key) const {
+        LeafNode *tmp = find_leaf(key);
         if (tmp == nullptr) {
             return {nullptr, 0};
         }
-        std::size_t ind = tmp->getChildIndex(key) + (tmp->getIndex(key) != neutral);
+        std::size_t ind = tmp->getUpperIndex(key);
         if (ind >= tmp->size) {
-            return {tmp->children[1], 0};
+            return {tmp->next, 0};
         }
         return {tmp, ind};
     }
 
-    std::pair<node_type *, std::size_t> tree_find(const Key &key) const {
-        node_type *tmp = find_leaf(key);
+    template <class K>
+    std::pair<LeafNode *, std::size_t> tree_find(const K &key) const {
+        LeafNode *tmp = find_leaf(key);
         if (tmp == nullptr) {
             return {nullptr, 0};
         }
@@ -806,4 +2802,4 @@ private:
     }
 };
 
-#endif
\ No newline at end of file
+#endif
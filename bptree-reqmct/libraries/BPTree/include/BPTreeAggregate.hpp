@@ -0,0 +1,61 @@
+#ifndef BPTREE_AGGREGATE_HPP
+#define BPTREE_AGGREGATE_HPP
+
+#include <algorithm>
+#include <limits>
+
+// Aggregate policies for BPTree. A policy is a monoid over values: 'lift' turns a value into an element of 'type',
+// 'combine' is associative (not necessarily commutative, the arguments come in key order) and 'identity' is neutral
+// to it. The tree caches the aggregate of every subtree next to the pointer to it.
+namespace bptree {
+
+// no aggregates are kept
+struct NoAggregate {
+    struct type {};
+};
+
+template <class T>
+struct Sum {
+    using type = T;
+
+    static T identity() { return T(); }
+
+    template <class Value>
+    static T lift(const Value &value) {
+        return static_cast<T>(value);
+    }
+
+    static T combine(const T &first, const T &second) { return first + second; }
+};
+
+template <class T>
+struct Min {
+    using type = T;
+
+    static T identity() { return std::numeric_limits<T>::max(); }
+
+    template <class Value>
+    static T lift(const Value &value) {
+        return static_cast<T>(value);
+    }
+
+    static T combine(const T &first, const T &second) { return std::min(first, second); }
+};
+
+template <class T>
+struct Max {
+    using type = T;
+
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+
+    template <class Value>
+    static T lift(const Value &value) {
+        return static_cast<T>(value);
+    }
+
+    static T combine(const T &first, const T &second) { return std::max(first, second); }
+};
+
+}  // namespace bptree
+
+#endif
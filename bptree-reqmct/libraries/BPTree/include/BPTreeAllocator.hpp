@@ -0,0 +1,111 @@
+#ifndef BPTREE_ALLOCATOR_HPP
+#define BPTREE_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Node allocators for BPTree. An allocator hands out blocks of 'Size' bytes aligned to 'Align' through allocate() and
+// takes them back through deallocate(); if 'releases_all' is set, release() frees every block at once and the tree
+// skips returning its nodes one by one.
+namespace bptree {
+
+// blocks are carved out of arenas that double in size up to 'MaxArenaBytes'; freed blocks are kept in an intrusive
+// free list and handed out again before the arena grows
+template <std::size_t Size, std::size_t Align, std::size_t MaxArenaBytes = std::size_t(1) << 20>
+class Arena {
+    static_assert((Align & (Align - 1)) == 0, "alignment must be a power of two");
+
+    static constexpr std::size_t stride     = (std::max(Size, sizeof(void *)) + Align - 1) / Align * Align;
+    static constexpr std::size_t max_blocks = std::max<std::size_t>(MaxArenaBytes / stride, 1);
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    std::vector<void *> arenas;
+    FreeBlock *free_list = nullptr;
+    char *cursor         = nullptr;
+    std::size_t left     = 0;
+    std::size_t blocks   = 0;
+
+public:
+    static constexpr bool releases_all = true;
+
+    Arena() = default;
+
+    Arena(const Arena &) = delete;
+
+    Arena(Arena &&other) noexcept { swap(other); }
+
+    Arena &operator=(const Arena &) = delete;
+
+    Arena &operator=(Arena &&other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~Arena() { release(); }
+
+    void *allocate() {
+        if (free_list != nullptr) {
+            void *block = free_list;
+            free_list   = free_list->next;
+            return block;
+        }
+        if (left == 0) {
+            blocks = std::min(std::max<std::size_t>(2 * blocks, 1), max_blocks);
+            cursor = static_cast<char *>(::operator new(blocks * stride, std::align_val_t(Align)));
+            left   = blocks;
+            arenas.push_back(cursor);
+        }
+        void *block = cursor;
+        cursor += stride;
+        left--;
+        return block;
+    }
+
+    void deallocate(void *block) { free_list = ::new (block) FreeBlock{free_list}; }
+
+    // frees every arena, all blocks handed out so far become invalid
+    void release() {
+        for (void *arena : arenas) {
+            ::operator delete(arena, std::align_val_t(Align));
+        }
+        arenas.clear();
+        free_list = nullptr;
+        cursor    = nullptr;
+        left      = 0;
+        blocks    = 0;
+    }
+
+    std::size_t arena_count() const { return arenas.size(); }
+
+    void swap(Arena &other) noexcept {
+        std::swap(arenas, other.arenas);
+        std::swap(free_list, other.free_list);
+        std::swap(cursor, other.cursor);
+        std::swap(left, other.left);
+        std::swap(blocks, other.blocks);
+    }
+};
+
+// every block comes straight from the global heap
+template <std::size_t Size, std::size_t Align>
+struct HeapAllocator {
+    static constexpr bool releases_all = false;
+
+    void *allocate() { return ::operator new(Size, std::align_val_t(Align)); }
+
+    void deallocate(void *block) { ::operator delete(block, std::align_val_t(Align)); }
+
+    void release() {}
+
+    void swap(HeapAllocator &) noexcept {}
+};
+
+}  // namespace bptree
+
+#endif
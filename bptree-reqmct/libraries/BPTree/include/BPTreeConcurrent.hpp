@@ -0,0 +1,469 @@
+#ifndef BPTREE_CONCURRENT_HPP
+#define BPTREE_CONCURRENT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "BPTreeSearch.hpp"
+
+// A B+-tree for any number of concurrent readers and writers, built on optimistic lock coupling: every node carries
+// a version, readers take no locks at all and start over if a version they passed has changed, writers lock only the
+// nodes they modify. Keys and values are read while they may be overwritten, so both have to be trivially copyable.
+// Erased elements leave their leaves underfull rather than merging them, and nodes are freed only with the tree.
+template <class Key, class Value, std::size_t BlockSize = 4096, class Less = std::less<Key>,
+          class Search = bptree::DefaultSearch<Key, Less>>
+class ConcurrentBPTree {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "optimistic readers need trivially copyable keys and values");
+
+    // the version counts by 2 on every change of the node, bit 1 is set while a writer holds the node
+    class VersionLock {
+        std::atomic<std::uint64_t> version{0};
+
+    public:
+        // 'restart' is set if the node is being written right now
+        std::uint64_t read_lock(bool &restart) const {
+            const std::uint64_t current = version.load(std::memory_order_acquire);
+            if ((current & 2) != 0) {
+                std::this_thread::yield();
+                restart = true;
+            }
+            return current;
+        }
+
+        // 'restart' is set if the node has changed since 'expected' was read, anything read in between is void then
+        void check(std::uint64_t expected, bool &restart) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (version.load(std::memory_order_relaxed) != expected) {
+                restart = true;
+            }
+        }
+
+        void upgrade(std::uint64_t &expected, bool &restart) {
+            if (version.compare_exchange_strong(expected, expected + 2, std::memory_order_acquire)) {
+                expected += 2;
+            } else {
+                restart = true;
+            }
+        }
+
+        void write_unlock() { version.fetch_add(2, std::memory_order_release); }
+    };
+
+    struct Node {
+        VersionLock lock;
+        std::size_t size;
+        bool is_leaf;
+    };
+
+    static constexpr std::size_t min_size = 3;
+
+    static constexpr std::size_t fit(const std::size_t slot) {
+        return std::max(BlockSize > sizeof(Node) + sizeof(void *) ? (BlockSize - sizeof(Node) - sizeof(void *)) / slot
+                                                                   : 0,
+                        min_size);
+    }
+
+    static constexpr std::size_t internal_size = fit(sizeof(Key) + sizeof(void *));
+    static constexpr std::size_t leaf_size     = fit(sizeof(Key) + sizeof(Value));
+
+    // a size read without a lock may be torn or stale, so positions are kept within the arrays until validated
+    static std::size_t bounded(const std::size_t size, const std::size_t capacity) { return std::min(size, capacity); }
+
+    struct InternalNode: Node {
+        Key keys[internal_size];
+        Node *children[internal_size + 1];
+
+        InternalNode() {
+            this->size    = 0;
+            this->is_leaf = false;
+        }
+
+        std::size_t getChildIndex(const Key &find) const {
+            return Search::template lower_bound<Less>(keys, bounded(this->size, internal_size), find,
+                                                      bptree::Identity{});
+        }
+
+        std::size_t getUpperIndex(const Key &find) const {
+            return Search::template upper_bound<Less>(keys, bounded(this->size, internal_size), find,
+                                                      bptree::Identity{});
+        }
+
+        void insert_at(std::size_t ind, const Key &key, Node *child) {
+            for (std::size_t i = this->size; i > ind; i--) {
+                keys[i]         = keys[i - 1];
+                children[i + 1] = children[i];
+            }
+            keys[ind]         = key;
+            children[ind + 1] = child;
+            this->size++;
+        }
+
+        // moves the upper half to 'right', the separator between the halves is returned
+        Key split_node(InternalNode *right) {
+            const std::size_t mid = this->size / 2;
+            right->size           = this->size - mid - 1;
+            std::copy(keys + mid + 1, keys + this->size, right->keys);
+            std::copy(children + mid + 1, children + this->size + 1, right->children);
+            this->size = mid;
+            return keys[mid];
+        }
+    };
+
+    struct LeafNode: Node {
+        Key keys[leaf_size];
+        Value values[leaf_size];
+
+        LeafNode() {
+            this->size    = 0;
+            this->is_leaf = true;
+        }
+
+        std::size_t getChildIndex(const Key &find) const {
+            return Search::template lower_bound<Less>(keys, bounded(this->size, leaf_size), find, bptree::Identity{});
+        }
+
+        std::size_t getUpperIndex(const Key &find) const {
+            return Search::template upper_bound<Less>(keys, bounded(this->size, leaf_size), find, bptree::Identity{});
+        }
+
+        void insert_at(std::size_t ind, const Key &key, const Value &value) {
+            for (std::size_t i = this->size; i > ind; i--) {
+                keys[i]   = keys[i - 1];
+                values[i] = values[i - 1];
+            }
+            keys[ind]   = key;
+            values[ind] = value;
+            this->size++;
+        }
+
+        void delete_by_ind(std::size_t ind) {
+            for (std::size_t i = ind; i + 1 < this->size; i++) {
+                keys[i]   = keys[i + 1];
+                values[i] = values[i + 1];
+            }
+            this->size--;
+        }
+
+        // moves the upper half to 'right', the largest key left here separates the halves
+        Key split_node(LeafNode *right) {
+            const std::size_t mid = this->size / 2;
+            right->size           = this->size - mid;
+            std::copy(keys + mid, keys + this->size, right->keys);
+            std::copy(values + mid, values + this->size, right->values);
+            this->size = mid;
+            return keys[mid - 1];
+        }
+    };
+
+    static bool equal(const Key &first, const Key &second) { return !Less{}(first, second) && !Less{}(second, first); }
+
+public:
+    using key_type    = Key;
+    using mapped_type = Value;
+    using value_type  = std::pair<Key, Value>;
+    using size_type   = std::size_t;
+
+    static constexpr std::size_t internal_capacity() { return internal_size; }
+    static constexpr std::size_t leaf_capacity() { return leaf_size; }
+
+    ConcurrentBPTree() : root(new LeafNode()) {}
+
+    ConcurrentBPTree(const ConcurrentBPTree &) = delete;
+
+    ConcurrentBPTree &operator=(const ConcurrentBPTree &) = delete;
+
+    ~ConcurrentBPTree() { destroy(root.load()); }
+
+    size_type size() const { return tree_size.load(std::memory_order_relaxed); }
+
+    bool empty() const { return size() == 0; }
+
+    // NB: as with BPTree::insert, the value of an existing key is overwritten; returns whether the key is new
+    bool insert(const Key &key, const Value &value) {
+        while (true) {
+            bool inserted = false;
+            if (try_insert(key, value, inserted)) {
+                return inserted;
+            }
+        }
+    }
+
+    std::optional<Value> find(const Key &key) const {
+        while (true) {
+            std::optional<Value> result;
+            if (try_find(key, result)) {
+                return result;
+            }
+        }
+    }
+
+    bool contains(const Key &key) const { return find(key).has_value(); }
+
+    size_type erase(const Key &key) {
+        while (true) {
+            bool erased = false;
+            if (try_erase(key, erased)) {
+                return erased;
+            }
+        }
+    }
+
+    // calls 'callback(element)' for the elements of [lo, hi) in order, a callback returning bool stops the scan with
+    // false. Every leaf is copied out and validated before its elements are passed on, so each leaf is seen as of
+    // one moment, but the leaves are not seen as of the same one
+    template <class Callback>
+    void scan(const Key &lo, const Key &hi, Callback callback) const {
+        if (!Less{}(lo, hi)) {
+            return;
+        }
+        value_type buffer[leaf_size];
+        Key from       = lo;
+        bool inclusive = true;
+        while (true) {
+            std::size_t count = 0;
+            bool last         = false;
+            while (!try_copy_leaf(from, inclusive, hi, buffer, count, last)) {
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                if constexpr (std::is_same_v<std::invoke_result_t<Callback &, const value_type &>, bool>) {
+                    if (!callback(buffer[i])) {
+                        return;
+                    }
+                } else {
+                    callback(buffer[i]);
+                }
+            }
+            if (last) {
+                return;
+            }
+            inclusive = false;
+        }
+    }
+
+private:
+    std::atomic<Node *> root;
+    std::atomic<size_type> tree_size{0};
+
+    static void destroy(Node *node) {
+        if (node->is_leaf) {
+            delete static_cast<LeafNode *>(node);
+            return;
+        }
+        InternalNode *internal = static_cast<InternalNode *>(node);
+        for (std::size_t i = 0; i <= internal->size; i++) {
+            destroy(internal->children[i]);
+        }
+        delete internal;
+    }
+
+    // puts a new root with the two halves of the old one on top of the tree
+    void grow(Node *left, const Key &key, Node *right) {
+        InternalNode *node = new InternalNode();
+        node->children[0]  = left;
+        node->insert_at(0, key, right);
+        root.store(node, std::memory_order_release);
+    }
+
+    // full nodes are split on the way down, so a split never has to go up: the node and its parent are locked, the
+    // node is split, and the descent starts over. Returns false if it has to start over
+    template <class node_type>
+    bool split(node_type *node, std::uint64_t &version, InternalNode *parent, std::uint64_t &parent_version) {
+        bool restart = false;
+        if (parent != nullptr) {
+            parent->lock.upgrade(parent_version, restart);
+            if (restart) {
+                return false;
+            }
+        }
+        node->lock.upgrade(version, restart);
+        if (restart) {
+            if (parent != nullptr) {
+                parent->lock.write_unlock();
+            }
+            return false;
+        }
+        if (parent == nullptr && node != root.load(std::memory_order_acquire)) {
+            node->lock.write_unlock();
+            return false;
+        }
+        node_type *right = new node_type();
+        const Key key    = node->split_node(right);
+        if (parent != nullptr) {
+            parent->insert_at(parent->getChildIndex(key), key, right);
+        } else {
+            grow(node, key, right);
+        }
+        node->lock.write_unlock();
+        if (parent != nullptr) {
+            parent->lock.write_unlock();
+        }
+        return false;
+    }
+
+    // takes the version of 'child', read from 'internal' as of 'internal_version', into 'version'. The parent is
+    // checked before the child is touched, as the pointer may be void, and again after its version is read, as the
+    // child may have been split in between and no longer hold the key it was chosen for. Returns false if the descent
+    // has to start over
+    static bool read_child(const InternalNode *internal, const std::uint64_t internal_version, Node *child,
+                           std::uint64_t &version) {
+        bool restart = false;
+        internal->lock.check(internal_version, restart);
+        if (restart) {
+            return false;
+        }
+        version = child->lock.read_lock(restart);
+        internal->lock.check(internal_version, restart);
+        return !restart;
+    }
+
+    // descends to the leaf of 'key' with the versions of the leaf and its parent, splitting full internal nodes on
+    // the way if 'split_full' is set; returns null if the descent has to start over
+    LeafNode *descend(const Key &key, const bool split_full, std::uint64_t &version, InternalNode *&parent,
+                      std::uint64_t &parent_version) {
+        bool restart = false;
+        Node *node   = root.load(std::memory_order_acquire);
+        version      = node->lock.read_lock(restart);
+        if (restart || node != root.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        parent = nullptr;
+        while (!node->is_leaf) {
+            InternalNode *internal = static_cast<InternalNode *>(node);
+            if (split_full && internal->size == internal_size) {
+                split(internal, version, parent, parent_version);
+                return nullptr;
+            }
+            parent         = internal;
+            parent_version = version;
+            node           = internal->children[internal->getChildIndex(key)];
+            if (!read_child(internal, parent_version, node, version)) {
+                return nullptr;
+            }
+        }
+        return static_cast<LeafNode *>(node);
+    }
+
+    bool try_insert(const Key &key, const Value &value, bool &inserted) {
+        std::uint64_t version = 0, parent_version = 0;
+        InternalNode *parent  = nullptr;
+        LeafNode *leaf        = descend(key, true, version, parent, parent_version);
+        if (leaf == nullptr) {
+            return false;
+        }
+        if (leaf->size == leaf_size) {
+            return split(leaf, version, parent, parent_version);
+        }
+        bool restart = false;
+        leaf->lock.upgrade(version, restart);
+        if (restart) {
+            return false;
+        }
+        const std::size_t ind = leaf->getChildIndex(key);
+        if (ind < leaf->size && equal(leaf->keys[ind], key)) {
+            leaf->values[ind] = value;
+        } else {
+            leaf->insert_at(ind, key, value);
+            tree_size.fetch_add(1, std::memory_order_relaxed);
+            inserted = true;
+        }
+        leaf->lock.write_unlock();
+        return true;
+    }
+
+    bool try_erase(const Key &key, bool &erased) {
+        std::uint64_t version = 0, parent_version = 0;
+        InternalNode *parent  = nullptr;
+        LeafNode *leaf        = descend(key, false, version, parent, parent_version);
+        if (leaf == nullptr) {
+            return false;
+        }
+        bool restart = false;
+        leaf->lock.upgrade(version, restart);
+        if (restart) {
+            return false;
+        }
+        const std::size_t ind = leaf->getChildIndex(key);
+        if (ind < leaf->size && equal(leaf->keys[ind], key)) {
+            leaf->delete_by_ind(ind);
+            tree_size.fetch_sub(1, std::memory_order_relaxed);
+            erased = true;
+        }
+        leaf->lock.write_unlock();
+        return true;
+    }
+
+    bool try_find(const Key &key, std::optional<Value> &result) const {
+        bool restart = false;
+        Node *node   = root.load(std::memory_order_acquire);
+        std::uint64_t version = node->lock.read_lock(restart);
+        if (restart || node != root.load(std::memory_order_acquire)) {
+            return false;
+        }
+        while (!node->is_leaf) {
+            const InternalNode *internal = static_cast<const InternalNode *>(node);
+            Node *child                  = internal->children[internal->getChildIndex(key)];
+            if (!read_child(internal, version, child, version)) {
+                return false;
+            }
+            node = child;
+        }
+        const LeafNode *leaf  = static_cast<const LeafNode *>(node);
+        const std::size_t ind = leaf->getChildIndex(key);
+        if (ind < bounded(leaf->size, leaf_size) && equal(leaf->keys[ind], key)) {
+            result = leaf->values[ind];
+        }
+        leaf->lock.check(version, restart);
+        return !restart;
+    }
+
+    // copies the elements of [from, hi) of the leaf of 'from' ('from' itself is left out unless 'inclusive'), and
+    // moves 'from' to the separator above the leaf; 'last' tells that the leaves to the right hold nothing of the range
+    bool try_copy_leaf(Key &from, const bool inclusive, const Key &hi, value_type *buffer, std::size_t &count,
+                       bool &last) const {
+        bool restart = false;
+        Node *node   = root.load(std::memory_order_acquire);
+        std::uint64_t version = node->lock.read_lock(restart);
+        if (restart || node != root.load(std::memory_order_acquire)) {
+            return false;
+        }
+        bool bounded_above = false;
+        Key fence{};
+        while (!node->is_leaf) {
+            const InternalNode *internal = static_cast<const InternalNode *>(node);
+            const std::size_t ind = inclusive ? internal->getChildIndex(from) : internal->getUpperIndex(from);
+            if (ind < bounded(internal->size, internal_size)) {
+                fence         = internal->keys[ind];
+                bounded_above = true;
+            }
+            Node *child = internal->children[ind];
+            if (!read_child(internal, version, child, version)) {
+                return false;
+            }
+            node = child;
+        }
+        const LeafNode *leaf = static_cast<const LeafNode *>(node);
+        const std::size_t to = bounded(leaf->size, leaf_size);
+        count                = 0;
+        for (std::size_t i = inclusive ? leaf->getChildIndex(from) : leaf->getUpperIndex(from);
+             i < to && Less{}(leaf->keys[i], hi); i++) {
+            buffer[count++] = value_type(leaf->keys[i], leaf->values[i]);
+        }
+        leaf->lock.check(version, restart);
+        if (restart) {
+            return false;
+        }
+        last = !bounded_above || !Less{}(fence, hi);
+        from = fence;
+        return true;
+    }
+};
+
+#endif
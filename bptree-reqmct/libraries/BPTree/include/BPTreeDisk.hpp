@@ -0,0 +1,417 @@
+#ifndef BPTREE_DISK_HPP
+#define BPTREE_DISK_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BPTreeLog.hpp"
+#include "BPTreePager.hpp"
+#include "BPTreeSearch.hpp"
+
+// A B+-tree kept in a file of BlockSize pages: nodes refer to their children and the next leaf by page number, and
+// only the pages in the buffer pool are in memory, so a lookup reads at most 'height' pages however large the tree
+// is. Keys and values are stored as raw bytes and have to be trivially copyable. Page 0 holds the root, the size and
+// the height of the tree; it is written out by flush() and by the destructor. Erased elements leave their leaves
+// underfull rather than merging them.
+//
+// With a write-ahead log every change is logged before it is applied, and the pages reach the file only at
+// checkpoints: the buffer pool keeps dirty pages until then. A checkpoint logs the images of the dirty pages, writes
+// them in place and empties the log, so a crash at any moment leaves either the pages of the last checkpoint or their
+// images in the log; opening the tree puts them back and replays the changes logged after them.
+template <class Key, class Value, std::size_t BlockSize = 4096, class Less = std::less<Key>,
+          class Search = bptree::DefaultSearch<Key, Less>>
+class DiskBPTree {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "pages hold keys and values as raw bytes");
+
+    using page_id = bptree::page_id;
+    using Pool    = bptree::BufferPool<BlockSize>;
+    using Page    = typename Pool::Page;
+
+    struct PageHeader {
+        std::uint32_t is_leaf;
+        std::uint32_t size;
+        page_id next;
+    };
+
+    static constexpr std::size_t internal_size =
+        (BlockSize - sizeof(PageHeader) - sizeof(page_id)) / (sizeof(Key) + sizeof(page_id));
+    static constexpr std::size_t leaf_size = (BlockSize - sizeof(PageHeader)) / (sizeof(Key) + sizeof(Value));
+
+    static_assert(BlockSize > sizeof(PageHeader) + sizeof(page_id) && internal_size >= 3 && leaf_size >= 3,
+                  "a page has to hold at least three keys");
+
+    struct InternalPage {
+        PageHeader header;
+        Key keys[internal_size];
+        page_id children[internal_size + 1];
+
+        std::size_t getChildIndex(const Key &find) const {
+            return Search::template lower_bound<Less>(keys, header.size, find, bptree::Identity{});
+        }
+    };
+
+    struct LeafPage {
+        PageHeader header;
+        Key keys[leaf_size];
+        Value values[leaf_size];
+
+        std::size_t getChildIndex(const Key &find) const {
+            return Search::template lower_bound<Less>(keys, header.size, find, bptree::Identity{});
+        }
+
+        bool holds(const std::size_t ind, const Key &key) const {
+            return ind < header.size && !Less{}(key, keys[ind]);
+        }
+    };
+
+    static_assert(sizeof(InternalPage) <= BlockSize && sizeof(LeafPage) <= BlockSize);
+
+    static constexpr std::uint64_t magic = 0x4250547265650001ULL;
+
+    struct Meta {
+        std::uint64_t magic;
+        std::uint64_t block_size;
+        std::uint64_t key_size;
+        std::uint64_t value_size;
+        page_id root;
+        std::uint64_t size;
+        std::uint64_t height;
+    };
+
+public:
+    using key_type    = Key;
+    using mapped_type = Value;
+    using value_type  = std::pair<Key, Value>;
+    using size_type   = std::size_t;
+
+    static constexpr std::size_t internal_capacity() { return internal_size; }
+    static constexpr std::size_t leaf_capacity() { return leaf_size; }
+
+    // opens the tree stored in 'path' or creates an empty one there, 'pool_pages' pages are cached in memory
+    explicit DiskBPTree(const std::string &path, const std::size_t pool_pages = 1024) : pool(path, pool_pages) {
+        open(path, pool_pages);
+    }
+
+    // the same with a write-ahead log in 'path'.wal, synced as 'durability' asks; with an interval the log keeps a
+    // thread that syncs it. Recovery needs a buffer pool at least as large as the one that wrote the log, the changes
+    // since the last checkpoint have to fit in it
+    DiskBPTree(const std::string &path, const std::size_t pool_pages, const bptree::Durability &durability)
+        : pool(path, pool_pages), log(std::in_place, path + ".wal"), durability(durability) {
+        const std::vector<bptree::LogFile::Entry> entries = log->read_all();
+        std::size_t start                                 = 0;
+        for (std::size_t i = entries.size(); i > 0 && start == 0; i--) {
+            if (entries[i - 1].type == bptree::LogRecord::checkpoint) {
+                start = i;
+            }
+        }
+        for (std::size_t i = start > 0 ? start - 1 : 0; i > 0 && entries[i - 1].type == bptree::LogRecord::page; i--) {
+            page_id id = 0;
+            std::memcpy(&id, entries[i - 1].payload.data(), sizeof(id));
+            pool.restore(id, entries[i - 1].payload.data() + sizeof(id));
+        }
+        pool.flush();
+        pool.set_steal(false);
+        open(path, pool_pages);
+        replaying = true;
+        for (std::size_t i = start; i < entries.size(); i++) {
+            const unsigned char *payload = entries[i].payload.data();
+            Key key;
+            std::memcpy(&key, payload, sizeof(Key));
+            if (entries[i].type == bptree::LogRecord::insert) {
+                Value value;
+                std::memcpy(&value, payload + sizeof(Key), sizeof(Value));
+                insert(key, value);
+            } else if (entries[i].type == bptree::LogRecord::erase) {
+                erase(key);
+            }
+        }
+        replaying = false;
+        checkpoint();
+        if (durability.interval.count() > 0) {
+            log->sync_every(durability.interval);
+        }
+    }
+
+    DiskBPTree(const DiskBPTree &) = delete;
+
+    DiskBPTree &operator=(const DiskBPTree &) = delete;
+
+    ~DiskBPTree() {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+    size_type size() const { return meta.size; }
+
+    bool empty() const { return meta.size == 0; }
+
+    // a leaf alone has height 1, a lookup reads at most this many pages
+    size_type height() const { return meta.height; }
+
+    std::optional<Value> find(const Key &key) const {
+        Page page             = find_leaf(key);
+        const LeafPage *leaf  = page.template as<LeafPage>();
+        const std::size_t ind = leaf->getChildIndex(key);
+        if (leaf->holds(ind, key)) {
+            return leaf->values[ind];
+        }
+        return std::nullopt;
+    }
+
+    bool contains(const Key &key) const { return find(key).has_value(); }
+
+    // NB: as with BPTree::insert, the value of an existing key is overwritten; returns whether the key is new
+    bool insert(const Key &key, const Value &value) {
+        log_change(bptree::LogRecord::insert, key, &value);
+        std::vector<std::pair<page_id, std::size_t>> path;
+        Page page             = find_leaf(key, &path);
+        LeafPage *leaf        = page.template as<LeafPage>();
+        const std::size_t ind = leaf->getChildIndex(key);
+        page.mark_dirty();
+        if (leaf->holds(ind, key)) {
+            leaf->values[ind] = value;
+            commit_if_due();
+            return false;
+        }
+        meta.size++;
+        if (leaf->header.size < leaf_size) {
+            insert_slot(leaf, ind, key, value);
+            commit_if_due();
+            return true;
+        }
+        Page right_page       = pool.create();
+        LeafPage *right       = right_page.template as<LeafPage>();
+        const std::size_t mid = (leaf_size + 1) / 2;
+        right->header         = PageHeader{1, static_cast<std::uint32_t>(leaf_size - mid), leaf->header.next};
+        std::copy(leaf->keys + mid, leaf->keys + leaf_size, right->keys);
+        std::copy(leaf->values + mid, leaf->values + leaf_size, right->values);
+        leaf->header.size = static_cast<std::uint32_t>(mid);
+        leaf->header.next = right_page.id();
+        if (ind <= mid) {
+            insert_slot(leaf, ind, key, value);
+        } else {
+            insert_slot(right, ind - mid, key, value);
+        }
+        const Key separator = leaf->keys[leaf->header.size - 1];
+        const page_id child = right_page.id();
+        page                = Page();
+        right_page          = Page();
+        add_to_parent(path, separator, child);
+        commit_if_due();
+        return true;
+    }
+
+    size_type erase(const Key &key) {
+        Page page             = find_leaf(key);
+        LeafPage *leaf        = page.template as<LeafPage>();
+        const std::size_t ind = leaf->getChildIndex(key);
+        if (!leaf->holds(ind, key)) {
+            return 0;
+        }
+        log_change(bptree::LogRecord::erase, key, nullptr);
+        std::copy(leaf->keys + ind + 1, leaf->keys + leaf->header.size, leaf->keys + ind);
+        std::copy(leaf->values + ind + 1, leaf->values + leaf->header.size, leaf->values + ind);
+        leaf->header.size--;
+        page.mark_dirty();
+        meta.size--;
+        commit_if_due();
+        return 1;
+    }
+
+    // calls 'callback(element)' for every element of [lo, hi) in order, following the links between the leaves; a
+    // callback returning bool stops the scan with false
+    template <class Callback>
+    void scan(const Key &lo, const Key &hi, Callback callback) const {
+        if (!Less{}(lo, hi)) {
+            return;
+        }
+        Page page       = find_leaf(lo);
+        std::size_t ind = page.template as<LeafPage>()->getChildIndex(lo);
+        while (true) {
+            const LeafPage *leaf = page.template as<LeafPage>();
+            for (; ind < leaf->header.size; ind++) {
+                if (!Less{}(leaf->keys[ind], hi)) {
+                    return;
+                }
+                const value_type element(leaf->keys[ind], leaf->values[ind]);
+                if constexpr (std::is_same_v<std::invoke_result_t<Callback &, const value_type &>, bool>) {
+                    if (!callback(element)) {
+                        return;
+                    }
+                } else {
+                    callback(element);
+                }
+            }
+            if (leaf->header.next == 0) {
+                return;
+            }
+            page = pool.fetch(leaf->header.next);
+            ind  = 0;
+        }
+    }
+
+    // writes the header and every dirty page to the file and syncs it, through a checkpoint if there is a log
+    void flush() {
+        if (log) {
+            checkpoint();
+            return;
+        }
+        store_meta();
+        pool.flush();
+    }
+
+    // makes every change so far durable with a single sync of the log
+    void commit() {
+        if (log) {
+            log->commit();
+        }
+    }
+
+    // logs the images of the dirty pages, writes the pages in place and empties the log; the tree checkpoints by
+    // itself whenever the dirty pages are about to fill the buffer pool
+    void checkpoint() {
+        if (!log) {
+            flush();
+            return;
+        }
+        log->commit();
+        store_meta();
+        pool.for_each_dirty([this](const page_id id, const void *data) {
+            log->append(bptree::LogRecord::page, &id, sizeof(id), data, BlockSize);
+        });
+        log->append(bptree::LogRecord::checkpoint, nullptr, 0);
+        log->commit();
+        pool.flush();
+        log->truncate();
+    }
+
+    const Pool &buffer_pool() const { return pool; }
+
+    // the number of syncs of the log so far, each of them commits a group of changes
+    std::size_t log_syncs() const { return log ? log->syncs() : 0; }
+
+private:
+    mutable Pool pool;
+    Meta meta{};
+    std::optional<bptree::LogFile> log;
+    bptree::Durability durability;
+    bool replaying = false;
+
+    void open(const std::string &path, const std::size_t pool_pages) {
+        if (pool_pages < 4) {
+            throw std::invalid_argument("Incorrect buffer pool size");
+        }
+        if (pool.page_count() == 0) {
+            Page header = pool.create();
+            Page root   = pool.create();
+            root.template as<LeafPage>()->header.is_leaf = 1;
+            meta = Meta{magic, BlockSize, sizeof(Key), sizeof(Value), root.id(), 0, 1};
+            return;
+        }
+        meta = *pool.fetch(0).template as<Meta>();
+        if (meta.magic != magic || meta.block_size != BlockSize || meta.key_size != sizeof(Key) ||
+            meta.value_size != sizeof(Value)) {
+            throw std::runtime_error("Incompatible tree file " + path);
+        }
+    }
+
+    void store_meta() {
+        Page header                 = pool.fetch(0);
+        *header.template as<Meta>() = meta;
+        header.mark_dirty();
+    }
+
+    // a change dirties at most a page per level and a new page per split, one more for a new root; a replayed change
+    // is neither logged again nor checkpointed, the changes after the last checkpoint fitted in the pool before
+    void log_change(const bptree::LogRecord type, const Key &key, const Value *value) {
+        if (!log || replaying) {
+            return;
+        }
+        if (pool.dirty_count() + 2 * meta.height + 4 > pool.capacity()) {
+            checkpoint();
+        }
+        log->append(type, &key, sizeof(Key), value, value != nullptr ? sizeof(Value) : 0);
+    }
+
+    void commit_if_due() {
+        if (log && !replaying && log->due(durability)) {
+            log->commit();
+        }
+    }
+
+    // the leaf of 'key', the pages on the way down and the child taken in each of them go to 'path'
+    Page find_leaf(const Key &key, std::vector<std::pair<page_id, std::size_t>> *path = nullptr) const {
+        Page page = pool.fetch(meta.root);
+        while (page.template as<PageHeader>()->is_leaf == 0) {
+            const InternalPage *node = page.template as<InternalPage>();
+            const std::size_t ind    = node->getChildIndex(key);
+            if (path != nullptr) {
+                path->emplace_back(page.id(), ind);
+            }
+            page = pool.fetch(node->children[ind]);
+        }
+        return page;
+    }
+
+    static void insert_slot(LeafPage *leaf, const std::size_t ind, const Key &key, const Value &value) {
+        std::copy_backward(leaf->keys + ind, leaf->keys + leaf->header.size, leaf->keys + leaf->header.size + 1);
+        std::copy_backward(leaf->values + ind, leaf->values + leaf->header.size, leaf->values + leaf->header.size + 1);
+        leaf->keys[ind]   = key;
+        leaf->values[ind] = value;
+        leaf->header.size++;
+    }
+
+    // links 'child' right after the child taken on the last level of 'path', splitting the full pages on the way up
+    void add_to_parent(std::vector<std::pair<page_id, std::size_t>> &path, Key key, page_id child) {
+        while (!path.empty()) {
+            const auto [id, ind] = path.back();
+            path.pop_back();
+            Page page          = pool.fetch(id);
+            InternalPage *node = page.template as<InternalPage>();
+            page.mark_dirty();
+            std::vector<Key> keys(node->keys, node->keys + node->header.size);
+            std::vector<page_id> children(node->children, node->children + node->header.size + 1);
+            keys.insert(keys.begin() + ind, key);
+            children.insert(children.begin() + ind + 1, child);
+            if (keys.size() <= internal_size) {
+                std::copy(keys.begin(), keys.end(), node->keys);
+                std::copy(children.begin(), children.end(), node->children);
+                node->header.size++;
+                return;
+            }
+            const std::size_t mid = keys.size() / 2;
+            Page right_page       = pool.create();
+            InternalPage *right   = right_page.template as<InternalPage>();
+            node->header.size     = static_cast<std::uint32_t>(mid);
+            right->header         = PageHeader{0, static_cast<std::uint32_t>(keys.size() - mid - 1), 0};
+            std::copy(keys.begin(), keys.begin() + mid, node->keys);
+            std::copy(children.begin(), children.begin() + mid + 1, node->children);
+            std::copy(keys.begin() + mid + 1, keys.end(), right->keys);
+            std::copy(children.begin() + mid + 1, children.end(), right->children);
+            key   = keys[mid];
+            child = right_page.id();
+        }
+        Page root_page     = pool.create();
+        InternalPage *root = root_page.template as<InternalPage>();
+        root->header       = PageHeader{0, 1, 0};
+        root->keys[0]      = key;
+        root->children[0]  = meta.root;
+        root->children[1]  = child;
+        meta.root          = root_page.id();
+        meta.height++;
+    }
+};
+
+#endif
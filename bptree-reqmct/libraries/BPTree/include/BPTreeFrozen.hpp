@@ -0,0 +1,162 @@
+#ifndef BPTREE_FROZEN_HPP
+#define BPTREE_FROZEN_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BPTreeSearch.hpp"
+
+// An immutable B+-tree without pointers: the elements are one sorted array cut into leaves of BlockSize bytes, and
+// the largest key of every leaf is kept in a separate array in Eytzinger order (the children of item k are 2k and
+// 2k + 1), so a lookup walks down an implicit binary tree whose top levels share a few cache lines and whose next
+// levels are prefetched several steps ahead, then searches a single leaf. Iterators are positions in the array.
+template <class Key, class Value, std::size_t BlockSize = 256, class Less = std::less<Key>,
+          class Search = bptree::DefaultSearch<Key, Less>>
+class FrozenBPTree {
+public:
+    using key_type        = Key;
+    using mapped_type     = Value;
+    using value_type      = std::pair<Key, Value>;
+    using reference       = const value_type &;
+    using const_reference = const value_type &;
+    using size_type       = std::size_t;
+
+    using const_iterator         = typename std::vector<value_type>::const_iterator;
+    using iterator               = const_iterator;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using reverse_iterator       = const_reverse_iterator;
+
+private:
+    static constexpr std::size_t leaf_size = std::max<std::size_t>(1, BlockSize / sizeof(value_type));
+
+    // the descent requests the separators four levels below, which are 16 consecutive items
+    static constexpr std::size_t prefetch_step = 16;
+
+    struct SlotKey {
+        const Key &operator()(const value_type &slot) const { return slot.first; }
+    };
+
+    std::vector<value_type> elements;
+    std::vector<Key> separators;      // 1-based, separators[k] is the largest key of leaves[k]
+    std::vector<std::size_t> leaves;  // the number of the leaf behind separators[k]
+
+    std::size_t fill(const std::size_t k, std::size_t leaf) {
+        if (k < separators.size()) {
+            leaf          = fill(2 * k, leaf);
+            separators[k] = elements[std::min(elements.size(), (leaf + 1) * leaf_size) - 1].first;
+            leaves[k]     = leaf;
+            leaf          = fill(2 * k + 1, leaf + 1);
+        }
+        return leaf;
+    }
+
+    // the first leaf whose largest key is not less than 'key' (greater than 'key' for Upper), the number of leaves if
+    // there is none: the descent goes right past smaller separators and the answer is where it last went left
+    template <bool Upper>
+    std::size_t find_leaf(const Key &key) const {
+        const std::size_t count = separators.size();
+        std::size_t k           = 1;
+        while (k < count) {
+#if defined(__GNUC__)
+            __builtin_prefetch(separators.data() + std::min(k * prefetch_step, count - 1));
+#endif
+            // keys with out-of-line data are better off with a branch, as with BranchingSearch
+            const bool right = Upper ? !Less{}(key, separators[k]) : Less{}(separators[k], key);
+            if constexpr (std::is_trivially_copyable_v<Key>) {
+                k = 2 * k + right;
+            } else if (right) {
+                k = 2 * k + 1;
+            } else {
+                k = 2 * k;
+            }
+        }
+        while (k & 1) {
+            k >>= 1;
+        }
+        k >>= 1;
+        return k == 0 ? count - 1 : leaves[k];
+    }
+
+    template <bool Upper>
+    const_iterator bound(const Key &key) const {
+        const std::size_t leaf = find_leaf<Upper>(key);
+        if (leaf + 1 >= separators.size()) {
+            return end();
+        }
+        const std::size_t first = leaf * leaf_size;
+        const std::size_t size  = std::min(leaf_size, elements.size() - first);
+        const std::size_t ind =
+            Upper ? Search::template upper_bound<Less>(elements.data() + first, size, key, SlotKey{})
+                  : Search::template lower_bound<Less>(elements.data() + first, size, key, SlotKey{});
+        return begin() + static_cast<std::ptrdiff_t>(first + ind);
+    }
+
+public:
+    FrozenBPTree() : separators(1), leaves(1) {}
+
+    // NB: [begin, end) has to be sorted by key without duplicates, as the elements of a BPTree are
+    template <class InputIt>
+    FrozenBPTree(InputIt begin, InputIt end) : elements(begin, end) {
+        const std::size_t count = (elements.size() + leaf_size - 1) / leaf_size;
+        separators.resize(count + 1);
+        leaves.resize(count + 1);
+        fill(1, 0);
+    }
+
+    static constexpr std::size_t leaf_capacity() { return leaf_size; }
+
+    const_iterator begin() const { return elements.cbegin(); }
+
+    const_iterator cbegin() const { return elements.cbegin(); }
+
+    const_iterator end() const { return elements.cend(); }
+
+    const_iterator cend() const { return elements.cend(); }
+
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+
+    const_reverse_iterator crbegin() const { return const_reverse_iterator(end()); }
+
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    const_reverse_iterator crend() const { return const_reverse_iterator(begin()); }
+
+    bool empty() const { return elements.empty(); }
+
+    size_type size() const { return elements.size(); }
+
+    const_iterator lower_bound(const Key &key) const { return bound<false>(key); }
+
+    const_iterator upper_bound(const Key &key) const { return bound<true>(key); }
+
+    std::pair<const_iterator, const_iterator> equal_range(const Key &key) const {
+        const const_iterator start = lower_bound(key);
+        return {start, start != end() && !Less{}(key, start->first) ? std::next(start) : start};
+    }
+
+    const_iterator find(const Key &key) const {
+        const const_iterator found = lower_bound(key);
+        return found != end() && !Less{}(key, found->first) ? found : end();
+    }
+
+    bool contains(const Key &key) const { return find(key) != end(); }
+
+    size_type count(const Key &key) const { return contains(key); }
+
+    // 'at' method throws std::out_of_range if there is no such key
+    const Value &at(const Key &key) const {
+        const const_iterator found = find(key);
+        if (found == end()) {
+            throw std::out_of_range("Incorrect key");
+        }
+        return found->second;
+    }
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef BPTREE_IMAGE_HPP
+#define BPTREE_IMAGE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// The read-only image of a BPTree written by BPTree::save and mapped by MappedBPTree. The file is a sequence of
+// PageSize pages and nodes refer to each other by page number, so the image works at any address. Page 0 is the
+// header, pages 1..leaves are the full leaves in key order, and the internal levels follow bottom-up with the root
+// last. Keys and values are stored as raw bytes and have to be trivially copyable.
+namespace bptree {
+
+template <class Key, class Value, std::size_t PageSize>
+struct ImageFormat {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "an image holds keys and values as raw bytes");
+    static_assert(PageSize % alignof(std::max_align_t) == 0, "pages have to keep their contents aligned");
+
+    static constexpr std::uint64_t magic = 0x4250547265650002ULL;
+
+    static constexpr std::size_t internal_size =
+        (PageSize - sizeof(std::uint64_t) - sizeof(std::uint64_t)) / (sizeof(Key) + sizeof(std::uint64_t));
+    static constexpr std::size_t leaf_size = (PageSize - sizeof(std::uint64_t)) / (sizeof(Key) + sizeof(Value));
+
+    static_assert(internal_size >= 2 && leaf_size >= 1, "a page has to hold at least two keys");
+
+    struct Header {
+        std::uint64_t magic;
+        std::uint64_t page_size;
+        std::uint64_t key_size;
+        std::uint64_t value_size;
+        std::uint64_t size;
+        std::uint64_t height;
+        std::uint64_t root;
+        std::uint64_t leaves;
+        std::uint64_t pages;
+    };
+
+    // keys[i] is the largest key under children[i], the last child has no key
+    struct InternalPage {
+        std::uint64_t size;
+        Key keys[internal_size];
+        std::uint64_t children[internal_size + 1];
+    };
+
+    // the next leaf is the next page
+    struct LeafPage {
+        std::uint64_t size;
+        Key keys[leaf_size];
+        Value values[leaf_size];
+    };
+
+    static_assert(sizeof(Header) <= PageSize && sizeof(InternalPage) <= PageSize && sizeof(LeafPage) <= PageSize);
+};
+
+// writes an image of the elements given in key order: leaves go to the file as they fill up and only the largest
+// key of every node is kept for the levels above. The image is written next to 'path' and renamed over it at
+// finish(), so the processes that map the old file keep seeing it
+template <class Key, class Value, std::size_t PageSize>
+class ImageWriter {
+    using Format = ImageFormat<Key, Value, PageSize>;
+
+    std::string path;
+    std::string temporary;
+    std::ofstream out;
+    std::vector<unsigned char> page;
+    std::vector<Key> maxima;
+    std::uint64_t pages = 0;
+    std::uint64_t size  = 0;
+
+    template <class T>
+    T *page_as() {
+        std::memset(page.data(), 0, PageSize);
+        return new (page.data()) T;
+    }
+
+    void write_page() {
+        if (!out.write(reinterpret_cast<const char *>(page.data()), PageSize)) {
+            throw std::runtime_error("Cannot write " + temporary);
+        }
+        pages++;
+    }
+
+    void flush_leaf() {
+        typename Format::LeafPage *leaf = std::launder(reinterpret_cast<typename Format::LeafPage *>(page.data()));
+        if (leaf->size > 0) {
+            maxima.push_back(leaf->keys[leaf->size - 1]);
+            write_page();
+            page_as<typename Format::LeafPage>();
+        }
+    }
+
+public:
+    explicit ImageWriter(const std::string &path)
+        : path(path), temporary(path + ".tmp"), out(temporary, std::ios::binary | std::ios::trunc), page(PageSize) {
+        if (!out) {
+            throw std::runtime_error("Cannot open " + temporary);
+        }
+        page_as<typename Format::Header>();
+        write_page();
+        page_as<typename Format::LeafPage>();
+    }
+
+    ImageWriter(const ImageWriter &) = delete;
+
+    ImageWriter &operator=(const ImageWriter &) = delete;
+
+    ~ImageWriter() {
+        if (out.is_open()) {
+            out.close();
+            std::remove(temporary.c_str());
+        }
+    }
+
+    // NB: keys have to come in strictly increasing order
+    void add(const Key &key, const Value &value) {
+        typename Format::LeafPage *leaf = std::launder(reinterpret_cast<typename Format::LeafPage *>(page.data()));
+        leaf->keys[leaf->size]          = key;
+        leaf->values[leaf->size]        = value;
+        size++;
+        if (++leaf->size == Format::leaf_size) {
+            flush_leaf();
+        }
+    }
+
+    void finish() {
+        flush_leaf();
+        const std::uint64_t leaves = maxima.size();
+        std::uint64_t first        = 1;
+        std::uint64_t height       = leaves > 0 ? 1 : 0;
+        while (maxima.size() > 1) {
+            std::vector<Key> level;
+            const std::uint64_t next = pages;
+            for (std::size_t child = 0; child < maxima.size();) {
+                typename Format::InternalPage *node = page_as<typename Format::InternalPage>();
+                const std::size_t count = std::min<std::size_t>(maxima.size() - child, Format::internal_size + 1);
+                for (std::size_t i = 0; i < count; i++) {
+                    node->children[i] = first + child + i;
+                    if (i + 1 < count) {
+                        node->keys[i] = maxima[child + i];
+                    }
+                }
+                node->size = count - 1;
+                child += count;
+                level.push_back(maxima[child - 1]);
+                write_page();
+            }
+            maxima = std::move(level);
+            first  = next;
+            height++;
+        }
+        typename Format::Header *header = page_as<typename Format::Header>();
+        *header = typename Format::Header{Format::magic, PageSize, sizeof(Key), sizeof(Value), size, height,
+                                          leaves > 0 ? first : 0, leaves, pages};
+        if (!out.seekp(0) || !out.write(reinterpret_cast<const char *>(page.data()), PageSize)) {
+            throw std::runtime_error("Cannot write " + temporary);
+        }
+        out.close();
+        if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("Cannot write " + path);
+        }
+    }
+};
+
+}  // namespace bptree
+
+#endif
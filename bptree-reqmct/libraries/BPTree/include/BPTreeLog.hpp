@@ -0,0 +1,253 @@
+#ifndef BPTREE_LOG_HPP
+#define BPTREE_LOG_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The write-ahead log of the disk-backed BPTree: an append-only file of checksummed records. Records are collected in
+// memory and written and synced in groups, as often as the Durability settings ask for.
+namespace bptree {
+
+// a group of records is synced once 'operations' of them are waiting or 'interval' has passed since the first of
+// them, whichever comes first. The count is checked on each operation; the interval is kept by a background thread,
+// so the last records of a burst are synced in time even when no operation follows them. A pending group is synced
+// on commit() too
+struct Durability {
+    std::size_t operations = 1;
+    std::chrono::milliseconds interval{0};
+
+    static Durability per_operation() { return {1, std::chrono::milliseconds(0)}; }
+    static Durability per_operations(const std::size_t count) { return {count, std::chrono::milliseconds(0)}; }
+    static Durability per_interval(const std::chrono::milliseconds interval) { return {0, interval}; }
+};
+
+enum class LogRecord : std::uint32_t { insert = 1, erase = 2, page = 3, checkpoint = 4 };
+
+// The records are buffered under a mutex, so that the thread started by sync_every() may commit them while the
+// owner keeps appending; a failure of that thread is thrown by the next append() or commit()
+class LogFile {
+    using clock = std::chrono::steady_clock;
+
+    int fd = -1;
+    std::vector<unsigned char> pending;
+    std::size_t pending_records = 0;
+    clock::time_point first_pending;
+    std::size_t sync_count = 0;
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread syncer;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    [[noreturn]] static void fail(const std::string &what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    void rethrow_failure() {
+        if (failure) {
+            std::rethrow_exception(std::exchange(failure, nullptr));
+        }
+    }
+
+    void write_pending() {
+        if (pending.empty()) {
+            return;
+        }
+        for (std::size_t done = 0; done < pending.size();) {
+            const ssize_t written = ::write(fd, pending.data() + done, pending.size() - done);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail("Cannot write the log");
+            }
+            done += static_cast<std::size_t>(written);
+        }
+        if (::fdatasync(fd) != 0) {
+            fail("Cannot sync the log");
+        }
+        pending.clear();
+        pending_records = 0;
+        sync_count++;
+    }
+
+    // sleeps until the pending group is 'interval' old and syncs it, a group that commit() takes first is left alone
+    void sync_loop(const std::chrono::milliseconds interval) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping && !failure) {
+            if (pending_records == 0) {
+                wakeup.wait(lock);
+            } else if (clock::now() < first_pending + interval) {
+                wakeup.wait_until(lock, first_pending + interval);
+            } else {
+                try {
+                    write_pending();
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+            }
+        }
+    }
+
+    static std::uint32_t checksum(const unsigned char *data, const std::size_t bytes, std::uint32_t hash) {
+        for (std::size_t i = 0; i < bytes; i++) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    template <class T>
+    void put(const T &value) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+        pending.insert(pending.end(), bytes, bytes + sizeof(T));
+    }
+
+public:
+    // a record as it was read back: its type and payload
+    struct Entry {
+        LogRecord type;
+        std::vector<unsigned char> payload;
+    };
+
+    explicit LogFile(const std::string &path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            fail("Cannot open " + path);
+        }
+    }
+
+    LogFile(const LogFile &) = delete;
+
+    LogFile &operator=(const LogFile &) = delete;
+
+    ~LogFile() {
+        if (syncer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_one();
+            syncer.join();
+        }
+        ::close(fd);
+    }
+
+    // syncs every pending group once it is 'interval' old from a thread of its own, until the log is closed
+    void sync_every(const std::chrono::milliseconds interval) {
+        if (!syncer.joinable()) {
+            syncer = std::thread(&LogFile::sync_loop, this, interval);
+        }
+    }
+
+    // the record is only buffered, it is durable after the next commit()
+    void append(const LogRecord type, const void *first, const std::size_t first_bytes, const void *second = nullptr,
+                const std::size_t second_bytes = 0) {
+        std::unique_lock<std::mutex> lock(mutex);
+        rethrow_failure();
+        const bool first_record = pending_records == 0;
+        if (first_record) {
+            first_pending = clock::now();
+        }
+        const std::size_t start = pending.size();
+        put(static_cast<std::uint32_t>(type));
+        put(static_cast<std::uint32_t>(first_bytes + second_bytes));
+        const unsigned char *first_data  = static_cast<const unsigned char *>(first);
+        const unsigned char *second_data = static_cast<const unsigned char *>(second);
+        pending.insert(pending.end(), first_data, first_data + first_bytes);
+        pending.insert(pending.end(), second_data, second_data + second_bytes);
+        put(checksum(pending.data() + start, pending.size() - start, 2166136261u));
+        pending_records++;
+        lock.unlock();
+        if (first_record) {
+            wakeup.notify_one();
+        }
+    }
+
+    bool due(const Durability &durability) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending_records > 0 &&
+               ((durability.operations > 0 && pending_records >= durability.operations) ||
+                (durability.interval.count() > 0 && clock::now() - first_pending >= durability.interval));
+    }
+
+    // writes the buffered records and syncs the log, a group of them costs a single sync
+    void commit() {
+        std::lock_guard<std::mutex> lock(mutex);
+        rethrow_failure();
+        write_pending();
+    }
+
+    // drops every record, once they are all reflected in the synced pages
+    void truncate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+        pending_records = 0;
+        if (::ftruncate(fd, 0) != 0 || ::fsync(fd) != 0) {
+            fail("Cannot truncate the log");
+        }
+    }
+
+    // the records on disk up to the first one that is torn or damaged
+    std::vector<Entry> read_all() const {
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            fail("Cannot stat the log");
+        }
+        std::vector<unsigned char> data(static_cast<std::size_t>(status.st_size));
+        for (std::size_t done = 0; done < data.size();) {
+            const ssize_t read = ::pread(fd, data.data() + done, data.size() - done, static_cast<off_t>(done));
+            if (read <= 0) {
+                if (read < 0 && errno == EINTR) {
+                    continue;
+                }
+                data.resize(done);
+                break;
+            }
+            done += static_cast<std::size_t>(read);
+        }
+        std::vector<Entry> entries;
+        const std::size_t header = 2 * sizeof(std::uint32_t);
+        for (std::size_t offset = 0; offset + header + sizeof(std::uint32_t) <= data.size();) {
+            std::uint32_t type = 0, bytes = 0, stored = 0;
+            std::memcpy(&type, data.data() + offset, sizeof(type));
+            std::memcpy(&bytes, data.data() + offset + sizeof(type), sizeof(bytes));
+            if (data.size() - offset - header - sizeof(stored) < bytes) {
+                break;
+            }
+            std::memcpy(&stored, data.data() + offset + header + bytes, sizeof(stored));
+            if (stored != checksum(data.data() + offset, header + bytes, 2166136261u)) {
+                break;
+            }
+            const unsigned char *payload = data.data() + offset + header;
+            entries.push_back({static_cast<LogRecord>(type), std::vector<unsigned char>(payload, payload + bytes)});
+            offset += header + bytes + sizeof(stored);
+        }
+        return entries;
+    }
+
+    // number of syncs so far, every one of them commits a group of records
+    std::size_t syncs() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sync_count;
+    }
+};
+
+}  // namespace bptree
+
+#endif
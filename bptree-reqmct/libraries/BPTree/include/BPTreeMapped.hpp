@@ -0,0 +1,237 @@
+#ifndef BPTREE_MAPPED_HPP
+#define BPTREE_MAPPED_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BPTreeImage.hpp"
+#include "BPTreeSearch.hpp"
+
+// A read-only B+-tree served straight from a memory mapping of an image written by BPTree::save: opening it costs a
+// single mmap whatever the size of the image, nothing is deserialized, and every process mapping the same file shares
+// its pages through the page cache. Lookups touch 'height' pages, iteration walks the leaves in file order. Less has
+// to order the keys the same way as the tree that was saved.
+template <class Key, class Value, std::size_t BlockSize = 4096, class Less = std::less<Key>,
+          class Search = bptree::DefaultSearch<Key, Less>>
+class MappedBPTree {
+    using Format       = bptree::ImageFormat<Key, Value, BlockSize>;
+    using Header       = typename Format::Header;
+    using InternalPage = typename Format::InternalPage;
+    using LeafPage     = typename Format::LeafPage;
+
+    const unsigned char *memory = nullptr;
+    std::size_t bytes           = 0;
+    const Header *header        = nullptr;
+
+    template <class T>
+    const T *page(const std::uint64_t id) const {
+        return std::launder(reinterpret_cast<const T *>(memory + id * BlockSize));
+    }
+
+    // the leaf that holds the first key not less than 'key' if there is one
+    const LeafPage *find_leaf(const Key &key) const {
+        std::uint64_t id = header->root;
+        for (std::size_t level = 1; level < header->height; level++) {
+            const InternalPage *node = page<InternalPage>(id);
+            id = node->children[Search::template lower_bound<Less>(node->keys, node->size, key, bptree::Identity{})];
+        }
+        return page<LeafPage>(id);
+    }
+
+    void unmap() {
+        if (memory != nullptr) {
+            ::munmap(const_cast<unsigned char *>(memory), bytes);
+        }
+        memory = nullptr;
+        bytes  = 0;
+        header = nullptr;
+    }
+
+public:
+    using key_type    = Key;
+    using mapped_type = Value;
+    using value_type  = std::pair<Key, Value>;
+    using size_type   = std::size_t;
+
+    // keys and values stay apart in the leaves, so an element is seen through a pair of references
+    class const_iterator {
+        const LeafPage *leaf = nullptr;
+        std::size_t ind      = 0;
+
+        friend class MappedBPTree;
+
+        const_iterator(const LeafPage *leaf, const std::size_t ind) : leaf(leaf), ind(ind) {}
+
+        const LeafPage *neighbour(const std::ptrdiff_t step) const {
+            return std::launder(
+                reinterpret_cast<const LeafPage *>(reinterpret_cast<const unsigned char *>(leaf) + step * BlockSize));
+        }
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = std::pair<Key, Value>;
+        using reference         = std::pair<const Key &, const Value &>;
+
+        struct pointer {
+            reference element;
+
+            const reference *operator->() const { return &element; }
+        };
+
+        const_iterator() = default;
+
+        reference operator*() const { return reference(leaf->keys[ind], leaf->values[ind]); }
+
+        pointer operator->() const { return pointer{**this}; }
+
+        const Key &key() const { return leaf->keys[ind]; }
+
+        const Value &value() const { return leaf->values[ind]; }
+
+        const_iterator &operator++() {
+            if (++ind == leaf->size) {
+                leaf = neighbour(1);
+                ind  = 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        const_iterator &operator--() {
+            if (ind == 0) {
+                leaf = neighbour(-1);
+                ind  = leaf->size;
+            }
+            ind--;
+            return *this;
+        }
+
+        const_iterator operator--(int) {
+            const_iterator result = *this;
+            --*this;
+            return result;
+        }
+
+        bool operator==(const const_iterator &other) const { return leaf == other.leaf && ind == other.ind; }
+
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+    };
+
+    using iterator = const_iterator;
+
+    MappedBPTree() = default;
+
+    // maps the image in 'path' read-only
+    explicit MappedBPTree(const std::string &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+        }
+        struct stat status;
+        if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(BlockSize)) {
+            ::close(fd);
+            throw std::runtime_error("Incorrect tree image " + path);
+        }
+        bytes        = static_cast<std::size_t>(status.st_size);
+        void *mapped = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "Cannot map " + path);
+        }
+        memory = static_cast<const unsigned char *>(mapped);
+        header = page<Header>(0);
+        if (header->magic != Format::magic || header->page_size != BlockSize || header->key_size != sizeof(Key) ||
+            header->value_size != sizeof(Value) || header->pages * BlockSize > bytes) {
+            unmap();
+            throw std::runtime_error("Incompatible tree image " + path);
+        }
+    }
+
+    MappedBPTree(const MappedBPTree &) = delete;
+
+    MappedBPTree &operator=(const MappedBPTree &) = delete;
+
+    MappedBPTree(MappedBPTree &&other) noexcept
+        : memory(std::exchange(other.memory, nullptr)), bytes(std::exchange(other.bytes, 0)),
+          header(std::exchange(other.header, nullptr)) {}
+
+    MappedBPTree &operator=(MappedBPTree &&other) noexcept {
+        if (this != &other) {
+            unmap();
+            memory = std::exchange(other.memory, nullptr);
+            bytes  = std::exchange(other.bytes, 0);
+            header = std::exchange(other.header, nullptr);
+        }
+        return *this;
+    }
+
+    ~MappedBPTree() { unmap(); }
+
+    size_type size() const { return header != nullptr ? header->size : 0; }
+
+    bool empty() const { return size() == 0; }
+
+    // a leaf alone has height 1, a lookup touches at most this many pages
+    size_type height() const { return header != nullptr ? header->height : 0; }
+
+    const_iterator begin() const { return empty() ? end() : const_iterator(page<LeafPage>(1), 0); }
+
+    const_iterator end() const {
+        return header != nullptr ? const_iterator(page<LeafPage>(1 + header->leaves), 0) : const_iterator();
+    }
+
+    const_iterator lower_bound(const Key &key) const {
+        if (empty()) {
+            return end();
+        }
+        const LeafPage *leaf  = find_leaf(key);
+        const std::size_t ind = Search::template lower_bound<Less>(leaf->keys, leaf->size, key, bptree::Identity{});
+        if (ind == leaf->size) {
+            return ++const_iterator(leaf, ind - 1);
+        }
+        return const_iterator(leaf, ind);
+    }
+
+    const_iterator upper_bound(const Key &key) const {
+        const_iterator found = lower_bound(key);
+        return found != end() && !Less{}(key, found.key()) ? ++found : found;
+    }
+
+    const_iterator find(const Key &key) const {
+        const const_iterator found = lower_bound(key);
+        return found != end() && !Less{}(key, found.key()) ? found : end();
+    }
+
+    bool contains(const Key &key) const { return find(key) != end(); }
+
+    size_type count(const Key &key) const { return contains(key); }
+
+    const Value &at(const Key &key) const {
+        const const_iterator found = find(key);
+        if (found == end()) {
+            throw std::out_of_range("Incorrect key");
+        }
+        return found.value();
+    }
+};
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef BPTREE_PAGER_HPP
+#define BPTREE_PAGER_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Page storage for the disk-backed BPTree: a file of fixed-size pages and a buffer pool caching a fixed number of
+// them in memory. Pages are referred to by their number in the file; page 0 is never a node, so 0 also stands for
+// "no page".
+namespace bptree {
+
+using page_id = std::uint64_t;
+
+class PageFile {
+    int fd                 = -1;
+    std::size_t page_bytes = 0;
+    page_id pages          = 0;
+
+    [[noreturn]] static void fail(const std::string &what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+public:
+    PageFile(const std::string &path, const std::size_t page_bytes) : page_bytes(page_bytes) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            fail("Cannot open " + path);
+        }
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            ::close(fd);
+            fail("Cannot stat " + path);
+        }
+        pages = static_cast<page_id>(status.st_size) / page_bytes;
+    }
+
+    PageFile(const PageFile &) = delete;
+
+    PageFile &operator=(const PageFile &) = delete;
+
+    ~PageFile() { ::close(fd); }
+
+    page_id page_count() const { return pages; }
+
+    // the page gets its place in the file at once, its contents are up to the first write
+    page_id allocate() { return pages++; }
+
+    // makes room for the pages before 'count', whether they have been written or not
+    void reserve(const page_id count) { pages = std::max(pages, count); }
+
+    void read(const page_id id, void *buffer) const {
+        const ssize_t done = ::pread(fd, buffer, page_bytes, static_cast<off_t>(id * page_bytes));
+        if (done < 0) {
+            fail("Cannot read a page");
+        }
+        std::memset(static_cast<char *>(buffer) + done, 0, page_bytes - static_cast<std::size_t>(done));
+    }
+
+    void write(const page_id id, const void *buffer) {
+        if (::pwrite(fd, buffer, page_bytes, static_cast<off_t>(id * page_bytes)) != static_cast<ssize_t>(page_bytes)) {
+            fail("Cannot write a page");
+        }
+    }
+
+    void sync() {
+        if (::fsync(fd) != 0) {
+            fail("Cannot sync the page file");
+        }
+    }
+};
+
+// keeps up to 'capacity' pages in memory; a page stays in its frame while it is pinned by a handle, the rest are
+// evicted by the clock policy: the hand clears the reference bit of a recently used frame and takes the first one
+// found without it, writing it back first if it is dirty. Without 'steal' dirty pages are never evicted, so the file
+// keeps the pages as of the last flush() until the next one
+template <std::size_t PageSize>
+class BufferPool {
+    struct Frame {
+        page_id id       = 0;
+        std::size_t pins = 0;
+        bool used        = false;
+        bool dirty       = false;
+        bool referenced  = false;
+    };
+
+    static constexpr std::size_t page_align = (PageSize & (PageSize - 1)) == 0 ? PageSize : alignof(std::max_align_t);
+
+    PageFile file;
+    std::vector<Frame> frames;
+    unsigned char *memory = nullptr;
+    std::unordered_map<page_id, std::size_t> table;
+    std::size_t hand        = 0;
+    std::size_t dirty_pages = 0;
+    std::size_t read_count  = 0;
+    std::size_t write_count = 0;
+    bool steal              = true;
+
+    unsigned char *frame_data(const std::size_t frame) const { return memory + frame * PageSize; }
+
+    void write_back(const std::size_t frame) {
+        file.write(frames[frame].id, frame_data(frame));
+        frames[frame].dirty = false;
+        dirty_pages--;
+        write_count++;
+    }
+
+    void mark_dirty(const std::size_t frame) {
+        if (!frames[frame].dirty) {
+            frames[frame].dirty = true;
+            dirty_pages++;
+        }
+    }
+
+    std::size_t evict() {
+        for (std::size_t step = 0; step < 2 * frames.size(); step++) {
+            const std::size_t frame = hand;
+            hand                    = (hand + 1) % frames.size();
+            Frame &victim           = frames[frame];
+            if (victim.pins > 0 || (victim.dirty && !steal)) {
+                continue;
+            }
+            if (victim.referenced) {
+                victim.referenced = false;
+                continue;
+            }
+            if (victim.used) {
+                if (victim.dirty) {
+                    write_back(frame);
+                }
+                table.erase(victim.id);
+            }
+            victim = Frame{};
+            return frame;
+        }
+        throw std::runtime_error("All pages of the buffer pool are pinned or dirty");
+    }
+
+    std::size_t place(const page_id id) {
+        const std::size_t frame = evict();
+        frames[frame].id        = id;
+        frames[frame].used      = true;
+        table.emplace(id, frame);
+        return frame;
+    }
+
+public:
+    // pins a page for as long as it lives
+    class Page {
+        BufferPool *pool  = nullptr;
+        std::size_t frame = 0;
+
+        friend class BufferPool;
+
+        Page(BufferPool *pool, const std::size_t frame) : pool(pool), frame(frame) {
+            pool->frames[frame].pins++;
+            pool->frames[frame].referenced = true;
+        }
+
+    public:
+        Page() = default;
+
+        Page(const Page &) = delete;
+
+        Page(Page &&other) noexcept : pool(std::exchange(other.pool, nullptr)), frame(other.frame) {}
+
+        Page &operator=(Page &&other) noexcept {
+            std::swap(pool, other.pool);
+            std::swap(frame, other.frame);
+            return *this;
+        }
+
+        ~Page() {
+            if (pool != nullptr) {
+                pool->frames[frame].pins--;
+            }
+        }
+
+        page_id id() const { return pool->frames[frame].id; }
+
+        template <class T>
+        T *as() const {
+            return std::launder(reinterpret_cast<T *>(pool->frame_data(frame)));
+        }
+
+        // the page is written back before its frame is reused
+        void mark_dirty() { pool->mark_dirty(frame); }
+    };
+
+    BufferPool(const std::string &path, const std::size_t capacity) : file(path, PageSize), frames(capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Incorrect buffer pool size");
+        }
+        memory = static_cast<unsigned char *>(::operator new(capacity * PageSize, std::align_val_t(page_align)));
+    }
+
+    BufferPool(const BufferPool &) = delete;
+
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    ~BufferPool() { ::operator delete(memory, std::align_val_t(page_align)); }
+
+    Page fetch(const page_id id) {
+        const auto found = table.find(id);
+        if (found != table.end()) {
+            return Page(this, found->second);
+        }
+        const std::size_t frame = place(id);
+        try {
+            file.read(id, frame_data(frame));
+        } catch (...) {
+            table.erase(id);
+            frames[frame] = Frame{};
+            throw;
+        }
+        read_count++;
+        return Page(this, frame);
+    }
+
+    // a zeroed page at the end of the file, dirty from the start
+    Page create() {
+        const std::size_t frame = place(file.allocate());
+        std::memset(frame_data(frame), 0, PageSize);
+        mark_dirty(frame);
+        return Page(this, frame);
+    }
+
+    // overwrites the page with 'data', as a dirty page
+    void restore(const page_id id, const void *data) {
+        file.reserve(id + 1);
+        Page page = fetch(id);
+        std::memcpy(frame_data(page.frame), data, PageSize);
+        mark_dirty(page.frame);
+    }
+
+    // calls 'callback(id, data)' for every dirty page
+    template <class Callback>
+    void for_each_dirty(Callback callback) const {
+        for (std::size_t frame = 0; frame < frames.size(); frame++) {
+            if (frames[frame].used && frames[frame].dirty) {
+                callback(frames[frame].id, static_cast<const void *>(frame_data(frame)));
+            }
+        }
+    }
+
+    // writes every dirty page back and syncs the file
+    void flush() {
+        for (std::size_t frame = 0; frame < frames.size(); frame++) {
+            if (frames[frame].used && frames[frame].dirty) {
+                write_back(frame);
+            }
+        }
+        file.sync();
+    }
+
+    page_id page_count() const { return file.page_count(); }
+
+    std::size_t dirty_count() const { return dirty_pages; }
+
+    void set_steal(const bool allowed) { steal = allowed; }
+
+    std::size_t capacity() const { return frames.size(); }
+
+    // pages read from and written to the file so far
+    std::size_t reads() const { return read_count; }
+    std::size_t writes() const { return write_count; }
+};
+
+}  // namespace bptree
+
+#endif
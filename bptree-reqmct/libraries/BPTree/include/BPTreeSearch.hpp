@@ -0,0 +1,324 @@
+#ifndef BPTREE_SEARCH_HPP
+#define BPTREE_SEARCH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#define BPTREE_SIMD 1
+#endif
+
+// In-node search policies for BPTree. A policy looks for a key in a sorted array of 'size' elements, 'proj' extracts
+// the key of an element (leaves store key-value pairs, internal nodes store bare keys).
+namespace bptree {
+
+struct Identity {
+    template <class T>
+    constexpr const T &operator()(const T &value) const {
+        return value;
+    }
+};
+
+struct LinearSearch {
+    template <class Less, class T, class K, class Projection>
+    static std::size_t lower_bound(const T *data, const std::size_t size, const K &key, Projection proj) {
+        std::size_t i = 0;
+        while (i < size && Less{}(proj(data[i]), key)) {
+            i++;
+        }
+        return i;
+    }
+
+    template <class Less, class T, class K, class Projection>
+    static std::size_t upper_bound(const T *data, const std::size_t size, const K &key, Projection proj) {
+        std::size_t i = 0;
+        while (i < size && !Less{}(key, proj(data[i]))) {
+            i++;
+        }
+        return i;
+    }
+};
+
+// the loop has a fixed number of iterations for a given size and the only data dependent step is a conditional move
+struct BinarySearch {
+    template <class Less, class T, class K, class Projection>
+    static const T *narrow_lower(const T *base, std::size_t &size, const K &key, Projection proj,
+                                 const std::size_t window) {
+        while (size > window) {
+            const std::size_t half = size / 2;
+            base                   = Less{}(proj(base[half]), key) ? base + half : base;
+            size -= half;
+        }
+        return base;
+    }
+
+    template <class Less, class T, class K, class Projection>
+    static const T *narrow_upper(const T *base, std::size_t &size, const K &key, Projection proj,
+                                 const std::size_t window) {
+        while (size > window) {
+            const std::size_t half = size / 2;
+            base                   = Less{}(key, proj(base[half])) ? base : base + half;
+            size -= half;
+        }
+        return base;
+    }
+
+    template <class Less, class T, class K, class Projection>
+    static std::size_t lower_bound(const T *data, std::size_t size, const K &key, Projection proj) {
+        if (size == 0) {
+            return 0;
+        }
+        const T *base = narrow_lower<Less>(data, size, key, proj, 1);
+        return (base - data) + Less{}(proj(*base), key);
+    }
+
+    template <class Less, class T, class K, class Projection>
+    static std::size_t upper_bound(const T *data, std::size_t size, const K &key, Projection proj) {
+        if (size == 0) {
+            return 0;
+        }
+        const T *base = narrow_upper<Less>(data, size, key, proj, 1);
+        return (base - data) + !Less{}(key, proj(*base));
+    }
+};
+
+// keys with out-of-line data (e.g. std::string) make every comparison a likely cache miss; branching lets the CPU
+// speculate and start the next load early, while the conditional move serializes them
+struct BranchingSearch {
+    template <class Less, class T, class K, class Projection>
+    static std::size_t lower_bound(const T *data, const std::size_t size, const K &key, Projection proj) {
+        return std::lower_bound(data, data + size, key,
+                                [proj](const T &element, const K &x) { return Less{}(proj(element), x); }) -
+               data;
+    }
+
+    template <class Less, class T, class K, class Projection>
+    static std::size_t upper_bound(const T *data, const std::size_t size, const K &key, Projection proj) {
+        return std::upper_bound(data, data + size, key,
+                                [proj](const K &x, const T &element) { return Less{}(x, proj(element)); }) -
+               data;
+    }
+};
+
+namespace detail {
+
+template <class T, class = void>
+struct SimdTraits {
+    static constexpr bool enabled = false;
+};
+
+#ifdef BPTREE_SIMD
+
+template <class Vector, std::size_t Lanes, class Count>
+std::size_t sum_lanes(const Vector acc) {
+    alignas(sizeof(Vector)) Count lanes[Lanes];
+    std::memcpy(lanes, &acc, sizeof(Vector));
+    std::size_t result = 0;
+    for (std::size_t i = 0; i < Lanes; i++) {
+        result += static_cast<std::size_t>(lanes[i]);
+    }
+    return result;
+}
+
+// 32-bit integers, unsigned ones are compared as signed after flipping the sign bit
+template <class T>
+struct SimdTraits<T, std::enable_if_t<std::is_integral_v<T> && sizeof(T) == 4>> {
+    static constexpr bool enabled = true;
+
+    template <bool Greater>
+    static std::size_t count(const T *data, const std::size_t size, const T key) {
+        constexpr int sign = std::is_signed_v<T> ? 0 : INT32_MIN;
+        std::size_t i      = 0;
+        std::size_t result = 0;
+#ifdef __AVX2__
+        const __m256i bias  = _mm256_set1_epi32(sign);
+        const __m256i pivot = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(key)), bias);
+        __m256i acc         = _mm256_setzero_si256();
+        for (; i + 8 <= size; i += 8) {
+            const __m256i v =
+                _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), bias);
+            acc = _mm256_sub_epi32(acc, Greater ? _mm256_cmpgt_epi32(v, pivot) : _mm256_cmpgt_epi32(pivot, v));
+        }
+        result = sum_lanes<__m256i, 8, std::int32_t>(acc);
+#else
+        const __m128i bias  = _mm_set1_epi32(sign);
+        const __m128i pivot = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(key)), bias);
+        __m128i acc         = _mm_setzero_si128();
+        for (; i + 4 <= size; i += 4) {
+            const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), bias);
+            acc             = _mm_sub_epi32(acc, Greater ? _mm_cmpgt_epi32(v, pivot) : _mm_cmpgt_epi32(pivot, v));
+        }
+        result = sum_lanes<__m128i, 4, std::int32_t>(acc);
+#endif
+        for (; i < size; i++) {
+            result += Greater ? key < data[i] : data[i] < key;
+        }
+        return result;
+    }
+};
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+// 64-bit integers need pcmpgtq, so they are vectorized only with SSE4.2 or AVX2
+template <class T>
+struct SimdTraits<T, std::enable_if_t<std::is_integral_v<T> && sizeof(T) == 8>> {
+    static constexpr bool enabled = true;
+
+    template <bool Greater>
+    static std::size_t count(const T *data, const std::size_t size, const T key) {
+        constexpr long long sign = std::is_signed_v<T> ? 0 : INT64_MIN;
+        std::size_t i            = 0;
+        std::size_t result       = 0;
+#ifdef __AVX2__
+        const __m256i bias  = _mm256_set1_epi64x(sign);
+        const __m256i pivot = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(key)), bias);
+        __m256i acc         = _mm256_setzero_si256();
+        for (; i + 4 <= size; i += 4) {
+            const __m256i v =
+                _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), bias);
+            acc = _mm256_sub_epi64(acc, Greater ? _mm256_cmpgt_epi64(v, pivot) : _mm256_cmpgt_epi64(pivot, v));
+        }
+        result = sum_lanes<__m256i, 4, std::int64_t>(acc);
+#else
+        const __m128i bias  = _mm_set1_epi64x(sign);
+        const __m128i pivot = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(key)), bias);
+        __m128i acc         = _mm_setzero_si128();
+        for (; i + 2 <= size; i += 2) {
+            const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), bias);
+            acc             = _mm_sub_epi64(acc, Greater ? _mm_cmpgt_epi64(v, pivot) : _mm_cmpgt_epi64(pivot, v));
+        }
+        result = sum_lanes<__m128i, 2, std::int64_t>(acc);
+#endif
+        for (; i < size; i++) {
+            result += Greater ? key < data[i] : data[i] < key;
+        }
+        return result;
+    }
+};
+#endif
+
+template <>
+struct SimdTraits<float> {
+    static constexpr bool enabled = true;
+
+    template <bool Greater>
+    static std::size_t count(const float *data, const std::size_t size, const float key) {
+        std::size_t i      = 0;
+        std::size_t result = 0;
+#ifdef __AVX2__
+        const __m256 pivot = _mm256_set1_ps(key);
+        __m256i acc        = _mm256_setzero_si256();
+        for (; i + 8 <= size; i += 8) {
+            const __m256 v = _mm256_loadu_ps(data + i);
+            const __m256 m = Greater ? _mm256_cmp_ps(pivot, v, _CMP_LT_OQ) : _mm256_cmp_ps(v, pivot, _CMP_LT_OQ);
+            acc            = _mm256_sub_epi32(acc, _mm256_castps_si256(m));
+        }
+        result = sum_lanes<__m256i, 8, std::int32_t>(acc);
+#else
+        const __m128 pivot = _mm_set1_ps(key);
+        __m128i acc        = _mm_setzero_si128();
+        for (; i + 4 <= size; i += 4) {
+            const __m128 v = _mm_loadu_ps(data + i);
+            const __m128 m = Greater ? _mm_cmplt_ps(pivot, v) : _mm_cmplt_ps(v, pivot);
+            acc            = _mm_sub_epi32(acc, _mm_castps_si128(m));
+        }
+        result = sum_lanes<__m128i, 4, std::int32_t>(acc);
+#endif
+        for (; i < size; i++) {
+            result += Greater ? key < data[i] : data[i] < key;
+        }
+        return result;
+    }
+};
+
+template <>
+struct SimdTraits<double> {
+    static constexpr bool enabled = true;
+
+    template <bool Greater>
+    static std::size_t count(const double *data, const std::size_t size, const double key) {
+        std::size_t i      = 0;
+        std::size_t result = 0;
+#ifdef __AVX2__
+        const __m256d pivot = _mm256_set1_pd(key);
+        __m256i acc         = _mm256_setzero_si256();
+        for (; i + 4 <= size; i += 4) {
+            const __m256d v = _mm256_loadu_pd(data + i);
+            const __m256d m = Greater ? _mm256_cmp_pd(pivot, v, _CMP_LT_OQ) : _mm256_cmp_pd(v, pivot, _CMP_LT_OQ);
+            acc             = _mm256_sub_epi64(acc, _mm256_castpd_si256(m));
+        }
+        result = sum_lanes<__m256i, 4, std::int64_t>(acc);
+#else
+        const __m128d pivot = _mm_set1_pd(key);
+        __m128i acc         = _mm_setzero_si128();
+        for (; i + 2 <= size; i += 2) {
+            const __m128d v = _mm_loadu_pd(data + i);
+            const __m128d m = Greater ? _mm_cmplt_pd(pivot, v) : _mm_cmplt_pd(v, pivot);
+            acc             = _mm_sub_epi64(acc, _mm_castpd_si128(m));
+        }
+        result = sum_lanes<__m128i, 2, std::int64_t>(acc);
+#endif
+        for (; i < size; i++) {
+            result += Greater ? key < data[i] : data[i] < key;
+        }
+        return result;
+    }
+};
+
+#endif  // BPTREE_SIMD
+
+template <class Less, class T>
+constexpr bool natural_order = std::is_same_v<Less, std::less<T>> || std::is_same_v<Less, std::less<>>;
+
+template <class Less, class T, class K, class Projection>
+constexpr bool vectorizable =
+    SimdTraits<T>::enabled && natural_order<Less, T> && std::is_same_v<T, K> && std::is_same_v<Projection, Identity>;
+
+}  // namespace detail
+
+// binary search narrows the range down to a few cache lines which are then compared with vector instructions;
+// anything that cannot be vectorized falls back to the branchless binary search
+struct SimdSearch {
+    static constexpr std::size_t window = 16;
+
+    template <class Less, class T, class K, class Projection>
+    static std::size_t lower_bound(const T *data, std::size_t size, const K &key, Projection proj) {
+        if constexpr (detail::vectorizable<Less, T, K, Projection>) {
+            const T *base = BinarySearch::narrow_lower<Less>(data, size, key, proj, window);
+            return (base - data) + detail::SimdTraits<T>::template count<false>(base, size, key);
+        } else {
+            return BinarySearch::lower_bound<Less>(data, size, key, proj);
+        }
+    }
+
+    template <class Less, class T, class K, class Projection>
+    static std::size_t upper_bound(const T *data, std::size_t size, const K &key, Projection proj) {
+        if constexpr (detail::vectorizable<Less, T, K, Projection>) {
+            const T *base = BinarySearch::narrow_upper<Less>(data, size, key, proj, window);
+            return (base - data) + size - detail::SimdTraits<T>::template count<true>(base, size, key);
+        } else {
+            return BinarySearch::upper_bound<Less>(data, size, key, proj);
+        }
+    }
+};
+
+// with 128-bit vectors the final scan does not beat the last few steps of the binary search, so the vectorized search
+// is picked by default only when AVX2 is available
+#ifdef __AVX2__
+inline constexpr bool prefer_simd = true;
+#else
+inline constexpr bool prefer_simd = false;
+#endif
+
+template <class Key, class Less>
+using DefaultSearch = std::conditional_t<
+    prefer_simd && detail::SimdTraits<Key>::enabled && detail::natural_order<Less, Key>, SimdSearch,
+    std::conditional_t<std::is_trivially_copyable_v<Key>, BinarySearch, BranchingSearch>>;
+
+}  // namespace bptree
+
+#endif  // BPTREE_SEARCH_HPP
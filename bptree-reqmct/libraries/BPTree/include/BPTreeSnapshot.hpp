@@ -0,0 +1,471 @@
+#ifndef BPTREE_SNAPSHOT_HPP
+#define BPTREE_SNAPSHOT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "BPTreeSearch.hpp"
+
+// A B+-tree with O(1) snapshots. Nodes are reference counted and shared between the tree, its copies and its
+// snapshots; a write copies only the nodes on its root-to-leaf path (and the siblings it rebalances with) that are
+// shared, so a snapshot stays frozen while the tree goes on changing. Nodes have no parent pointers and leaves are not
+// linked, a node may belong to many trees at once. The tree itself is for one thread, snapshots may be read, copied
+// and dropped on any number of other threads.
+template <class Key, class Value, std::size_t BlockSize = 4096, class Less = std::less<Key>,
+          class Search = bptree::DefaultSearch<Key, Less>>
+class SnapshotBPTree {
+    struct Node {
+        mutable std::atomic<std::size_t> refs{1};
+        std::size_t size = 0;
+        bool is_leaf;
+
+        explicit Node(const bool is_leaf) : is_leaf(is_leaf) {}
+    };
+
+    static constexpr std::size_t min_size = 3;
+
+    static constexpr std::size_t fit(const std::size_t reserved, const std::size_t slot) {
+        return std::max(BlockSize > reserved ? (BlockSize - reserved) / slot : 0, min_size);
+    }
+
+    // an internal node has room for one key and child more than its order, it takes the key of a split below
+    // before it splits in turn
+    static constexpr std::size_t internal_size =
+        fit(sizeof(Node) + 2 * sizeof(void *) + sizeof(Key), sizeof(Key) + sizeof(void *));
+    static constexpr std::size_t leaf_size    = fit(sizeof(Node), sizeof(std::pair<Key, Value>));
+    static constexpr std::size_t internal_min = internal_size / 2;
+    static constexpr std::size_t leaf_min     = leaf_size / 2;
+
+    // every internal node but the root has at least two children, so no path from the root holds more levels
+    static constexpr std::size_t max_height = 64;
+
+    struct SlotKey {
+        const Key &operator()(const std::pair<Key, Value> &slot) const { return slot.first; }
+    };
+
+    static bool equal(const Key &first, const Key &second) { return !Less{}(first, second) && !Less{}(second, first); }
+
+    struct InternalNode: Node {
+        Key keys[internal_size + 1];
+        Node *children[internal_size + 2];
+
+        InternalNode() : Node(false) {}
+
+        std::size_t getChildIndex(const Key &find) const {
+            return Search::template lower_bound<Less>(keys, this->size, find, bptree::Identity{});
+        }
+
+        void insert_at(std::size_t ind, Key key, Node *child) {
+            for (std::size_t i = this->size; i > ind; i--) {
+                keys[i]         = std::move(keys[i - 1]);
+                children[i + 1] = children[i];
+            }
+            keys[ind]         = std::move(key);
+            children[ind + 1] = child;
+            this->size++;
+        }
+
+        // removes the key at 'ind' together with the child right after it
+        void delete_by_ind(std::size_t ind) {
+            for (std::size_t i = ind; i + 1 < this->size; i++) {
+                keys[i]         = std::move(keys[i + 1]);
+                children[i + 1] = children[i + 2];
+            }
+            this->size--;
+        }
+    };
+
+    struct LeafNode: Node {
+        std::pair<Key, Value> slots[leaf_size];
+
+        LeafNode() : Node(true) {}
+
+        std::size_t getChildIndex(const Key &find) const {
+            return Search::template lower_bound<Less>(slots, this->size, find, SlotKey{});
+        }
+
+        void insert_at(std::size_t ind, std::pair<Key, Value> element) {
+            for (std::size_t i = this->size; i > ind; i--) {
+                slots[i] = std::move(slots[i - 1]);
+            }
+            slots[ind] = std::move(element);
+            this->size++;
+        }
+
+        void delete_by_ind(std::size_t ind) {
+            for (std::size_t i = ind; i + 1 < this->size; i++) {
+                slots[i] = std::move(slots[i + 1]);
+            }
+            this->size--;
+            slots[this->size] = std::pair<Key, Value>();
+        }
+    };
+
+    static void acquire(const Node *node) {
+        if (node != nullptr) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // drops a reference, the last one frees the node and drops its references to the children
+    static void release(const Node *node) {
+        if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        if (node->is_leaf) {
+            delete static_cast<const LeafNode *>(node);
+            return;
+        }
+        const InternalNode *internal = static_cast<const InternalNode *>(node);
+        for (std::size_t i = 0; i <= internal->size; i++) {
+            release(internal->children[i]);
+        }
+        delete internal;
+    }
+
+    // makes the node in 'slot' private to this tree: a shared one is replaced with a copy, whose children gain a
+    // reference each. Only the tree holding the single reference may write to a node
+    static Node *own(Node *&slot) {
+        if (slot->refs.load(std::memory_order_acquire) == 1) {
+            return slot;
+        }
+        Node *copy = nullptr;
+        if (slot->is_leaf) {
+            LeafNode *leaf = new LeafNode();
+            std::copy(static_cast<LeafNode *>(slot)->slots, static_cast<LeafNode *>(slot)->slots + slot->size,
+                      leaf->slots);
+            copy = leaf;
+        } else {
+            const InternalNode *source = static_cast<const InternalNode *>(slot);
+            InternalNode *internal     = new InternalNode();
+            std::copy(source->keys, source->keys + source->size, internal->keys);
+            std::copy(source->children, source->children + source->size + 1, internal->children);
+            for (std::size_t i = 0; i <= source->size; i++) {
+                acquire(source->children[i]);
+            }
+            copy = internal;
+        }
+        copy->size = slot->size;
+        release(slot);
+        slot = copy;
+        return copy;
+    }
+
+    // the result of a split that the parent has to take: the separator and the new right node
+    struct Split {
+        Key key;
+        Node *right = nullptr;
+    };
+
+    template <class forward_type>
+    static Split insert_into(Node *&slot, const Key &key, forward_type &&value, bool &inserted) {
+        Node *node = own(slot);
+        if (node->is_leaf) {
+            LeafNode *leaf  = static_cast<LeafNode *>(node);
+            std::size_t ind = leaf->getChildIndex(key);
+            if (ind < leaf->size && equal(leaf->slots[ind].first, key)) {
+                leaf->slots[ind].second = std::forward<forward_type>(value);
+                return {};
+            }
+            inserted = true;
+            if (leaf->size < leaf_size) {
+                leaf->insert_at(ind, {key, std::forward<forward_type>(value)});
+                return {};
+            }
+            LeafNode *right       = new LeafNode();
+            const std::size_t mid = (leaf_size + 1) / 2;
+            std::move(leaf->slots + mid, leaf->slots + leaf->size, right->slots);
+            right->size = leaf->size - mid;
+            leaf->size  = mid;
+            if (ind <= mid) {
+                leaf->insert_at(ind, {key, std::forward<forward_type>(value)});
+            } else {
+                right->insert_at(ind - mid, {key, std::forward<forward_type>(value)});
+            }
+            return {leaf->slots[leaf->size - 1].first, right};
+        }
+        InternalNode *internal = static_cast<InternalNode *>(node);
+        const std::size_t ind  = internal->getChildIndex(key);
+        Split split            = insert_into(internal->children[ind], key, std::forward<forward_type>(value), inserted);
+        if (split.right == nullptr) {
+            return {};
+        }
+        internal->insert_at(ind, std::move(split.key), split.right);
+        if (internal->size <= internal_size) {
+            return {};
+        }
+        InternalNode *right   = new InternalNode();
+        const std::size_t mid = internal->size / 2;
+        std::move(internal->keys + mid + 1, internal->keys + internal->size, right->keys);
+        std::copy(internal->children + mid + 1, internal->children + internal->size + 1, right->children);
+        right->size    = internal->size - mid - 1;
+        internal->size = mid;
+        return {std::move(internal->keys[mid]), right};
+    }
+
+    static std::size_t min_fill(const Node *node) { return node->is_leaf ? leaf_min : internal_min; }
+
+    // refills the underfull child 'ind' of 'parent' from a sibling or merges the two
+    static void fix_child(InternalNode *parent, std::size_t ind) {
+        if (ind == parent->size) {
+            ind--;
+        }
+        Node *left  = own(parent->children[ind]);
+        Node *right = own(parent->children[ind + 1]);
+        if (left->is_leaf) {
+            LeafNode *left_leaf  = static_cast<LeafNode *>(left);
+            LeafNode *right_leaf = static_cast<LeafNode *>(right);
+            if (left->size + right->size <= leaf_size) {
+                std::move(right_leaf->slots, right_leaf->slots + right->size, left_leaf->slots + left->size);
+                left->size += right->size;
+                right->size = 0;
+                parent->delete_by_ind(ind);
+                release(right);
+                return;
+            }
+            while (left->size < leaf_min) {
+                left_leaf->insert_at(left->size, std::move(right_leaf->slots[0]));
+                right_leaf->delete_by_ind(0);
+            }
+            while (right->size < leaf_min) {
+                right_leaf->insert_at(0, std::move(left_leaf->slots[left->size - 1]));
+                left_leaf->delete_by_ind(left->size - 1);
+            }
+            parent->keys[ind] = left_leaf->slots[left->size - 1].first;
+            return;
+        }
+        InternalNode *left_node  = static_cast<InternalNode *>(left);
+        InternalNode *right_node = static_cast<InternalNode *>(right);
+        if (left->size + right->size < internal_size) {
+            left_node->keys[left->size] = std::move(parent->keys[ind]);
+            std::move(right_node->keys, right_node->keys + right->size, left_node->keys + left->size + 1);
+            std::copy(right_node->children, right_node->children + right->size + 1,
+                      left_node->children + left->size + 1);
+            left->size += right->size + 1;
+            parent->delete_by_ind(ind);
+            delete right_node;
+            return;
+        }
+        while (left->size < internal_min) {
+            left_node->insert_at(left->size, std::move(parent->keys[ind]), right_node->children[0]);
+            parent->keys[ind] = std::move(right_node->keys[0]);
+            right_node->children[0] = right_node->children[1];
+            right_node->delete_by_ind(0);
+        }
+        while (right->size < internal_min) {
+            right_node->insert_at(0, std::move(parent->keys[ind]), right_node->children[0]);
+            right_node->children[0] = left_node->children[left->size];
+            parent->keys[ind]       = std::move(left_node->keys[left->size - 1]);
+            left->size--;
+        }
+    }
+
+    // writes the child index of every level on the way to 'key' and then its slot in the leaf to 'path', without
+    // copying anything; returns whether the key is there
+    static bool locate(const Node *node, const Key &key, std::size_t *path) {
+        for (; !node->is_leaf; path++) {
+            const InternalNode *internal = static_cast<const InternalNode *>(node);
+            *path                        = internal->getChildIndex(key);
+            node                         = internal->children[*path];
+        }
+        const LeafNode *leaf = static_cast<const LeafNode *>(node);
+        *path                = leaf->getChildIndex(key);
+        return *path < leaf->size && equal(leaf->slots[*path].first, key);
+    }
+
+    // erases the element that locate() found, owning the nodes on the way down by the recorded indices
+    static void erase_at(Node *&slot, const std::size_t *path) {
+        Node *node = own(slot);
+        if (node->is_leaf) {
+            static_cast<LeafNode *>(node)->delete_by_ind(*path);
+            return;
+        }
+        InternalNode *internal = static_cast<InternalNode *>(node);
+        erase_at(internal->children[*path], path + 1);
+        if (internal->children[*path]->size < min_fill(internal->children[*path])) {
+            fix_child(internal, *path);
+        }
+    }
+
+    static const Value *find_in(const Node *node, const Key &key) {
+        if (node == nullptr) {
+            return nullptr;
+        }
+        while (!node->is_leaf) {
+            const InternalNode *internal = static_cast<const InternalNode *>(node);
+            node                         = internal->children[internal->getChildIndex(key)];
+        }
+        const LeafNode *leaf  = static_cast<const LeafNode *>(node);
+        const std::size_t ind = leaf->getChildIndex(key);
+        return ind < leaf->size && equal(leaf->slots[ind].first, key) ? &leaf->slots[ind].second : nullptr;
+    }
+
+    // calls 'callback' for the elements of [lo, hi) under 'node', returns false once the callback asked to stop
+    template <class Callback>
+    static bool scan_in(const Node *node, const Key &lo, const Key &hi, Callback &callback) {
+        if (node->is_leaf) {
+            const LeafNode *leaf = static_cast<const LeafNode *>(node);
+            for (std::size_t i = leaf->getChildIndex(lo); i < leaf->size && Less{}(leaf->slots[i].first, hi); i++) {
+                if constexpr (std::is_same_v<std::invoke_result_t<Callback &, const value_type &>, bool>) {
+                    if (!callback(leaf->slots[i])) {
+                        return false;
+                    }
+                } else {
+                    callback(leaf->slots[i]);
+                }
+            }
+            return true;
+        }
+        const InternalNode *internal = static_cast<const InternalNode *>(node);
+        const std::size_t to         = internal->getChildIndex(hi);
+        for (std::size_t i = internal->getChildIndex(lo); i <= to; i++) {
+            if (!scan_in(internal->children[i], lo, hi, callback)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    using key_type    = Key;
+    using mapped_type = Value;
+    using value_type  = std::pair<Key, Value>;
+    using size_type   = std::size_t;
+
+    // a frozen version of the tree, it holds on to the nodes of that version until it is dropped
+    class Snapshot {
+        const Node *root = nullptr;
+        size_type count  = 0;
+
+        friend class SnapshotBPTree;
+
+        Snapshot(const Node *root, const size_type count) : root(root), count(count) { acquire(root); }
+
+    public:
+        Snapshot() = default;
+
+        Snapshot(const Snapshot &other) : Snapshot(other.root, other.count) {}
+
+        Snapshot(Snapshot &&other) noexcept : root(std::exchange(other.root, nullptr)), count(other.count) {}
+
+        Snapshot &operator=(Snapshot other) noexcept {
+            std::swap(root, other.root);
+            std::swap(count, other.count);
+            return *this;
+        }
+
+        ~Snapshot() { release(root); }
+
+        size_type size() const { return count; }
+
+        bool empty() const { return count == 0; }
+
+        // the value stays valid as long as the snapshot lives
+        const Value *find(const Key &key) const { return find_in(root, key); }
+
+        bool contains(const Key &key) const { return find_in(root, key) != nullptr; }
+
+        // calls 'callback(element)' for every element of [lo, hi) in order; a callback returning bool stops the
+        // scan with false
+        template <class Callback>
+        void scan(const Key &lo, const Key &hi, Callback callback) const {
+            if (root != nullptr && Less{}(lo, hi)) {
+                scan_in(root, lo, hi, callback);
+            }
+        }
+    };
+
+    static constexpr std::size_t internal_capacity() { return internal_size; }
+    static constexpr std::size_t leaf_capacity() { return leaf_size; }
+
+    SnapshotBPTree() = default;
+
+    // a copy shares all nodes with the source until either of them writes
+    SnapshotBPTree(const SnapshotBPTree &other) : root(other.root), tree_size(other.tree_size) { acquire(root); }
+
+    SnapshotBPTree(SnapshotBPTree &&other) noexcept
+        : root(std::exchange(other.root, nullptr)), tree_size(std::exchange(other.tree_size, 0)) {}
+
+    SnapshotBPTree &operator=(SnapshotBPTree other) noexcept {
+        std::swap(root, other.root);
+        std::swap(tree_size, other.tree_size);
+        return *this;
+    }
+
+    ~SnapshotBPTree() { release(root); }
+
+    // O(1): the snapshot takes a reference to the current root
+    Snapshot snapshot() const { return Snapshot(root, tree_size); }
+
+    size_type size() const { return tree_size; }
+
+    bool empty() const { return tree_size == 0; }
+
+    void clear() {
+        release(root);
+        root      = nullptr;
+        tree_size = 0;
+    }
+
+    const Value *find(const Key &key) const { return find_in(root, key); }
+
+    bool contains(const Key &key) const { return find_in(root, key) != nullptr; }
+
+    template <class Callback>
+    void scan(const Key &lo, const Key &hi, Callback callback) const {
+        if (root != nullptr && Less{}(lo, hi)) {
+            scan_in(root, lo, hi, callback);
+        }
+    }
+
+    // NB: as with BPTree::insert, the value of an existing key is overwritten; returns whether the key is new
+    bool insert(const Key &key, const Value &value) { return insert_value(key, value); }
+
+    bool insert(const Key &key, Value &&value) { return insert_value(key, std::move(value)); }
+
+    size_type erase(const Key &key) {
+        std::size_t path[max_height + 1];
+        if (root == nullptr || !locate(root, key, path)) {
+            return 0;
+        }
+        erase_at(root, path);
+        tree_size--;
+        if (root->size == 0) {
+            Node *old = root;
+            root      = root->is_leaf ? nullptr : static_cast<InternalNode *>(root)->children[0];
+            if (old->is_leaf) {
+                release(old);
+            } else {
+                delete static_cast<InternalNode *>(old);
+            }
+        }
+        return 1;
+    }
+
+private:
+    Node *root          = nullptr;
+    size_type tree_size = 0;
+
+    template <class forward_type>
+    bool insert_value(const Key &key, forward_type &&value) {
+        if (root == nullptr) {
+            root = new LeafNode();
+        }
+        bool inserted = false;
+        Split split   = insert_into(root, key, std::forward<forward_type>(value), inserted);
+        if (split.right != nullptr) {
+            InternalNode *node = new InternalNode();
+            node->children[0]  = root;
+            node->insert_at(0, std::move(split.key), split.right);
+            root = node;
+        }
+        tree_size += inserted;
+        return inserted;
+    }
+};
+
+#endif
@@ -1,11 +1,14 @@
 #include <algorithm>
 #include <array>
 #include <iomanip>
+#include <iterator>
 #include <map>
 #include <memory>
+#include <numeric>
 #include <random>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
@@ -104,6 +107,30 @@ TYPED_TEST_SUITE(BPTreeTest, TestedTypes);
 
 }  // anonymous namespace
 
+TEST(BPTreeBasicTest, node_fits_block) {
+    EXPECT_EQ(4096, (BPTree<int, int>::internal_node_size()));
+    EXPECT_EQ(4096, (BPTree<int, int>::leaf_node_size()));
+    EXPECT_EQ(4096, (BPTree<int, std::string>::internal_node_size()));
+    EXPECT_EQ(4096, (BPTree<int, std::string>::leaf_node_size()));
+    EXPECT_EQ(512, (BPTree<std::string, std::string, 512>::internal_node_size()));
+    EXPECT_EQ(512, (BPTree<std::string, std::string, 512>::leaf_node_size()));
+    EXPECT_EQ(8192, (BPTree<long long, double, 8192>::internal_node_size()));
+    EXPECT_EQ(8192, (BPTree<long long, double, 8192>::leaf_node_size()));
+}
+
+TEST(BPTreeBasicTest, internal_fanout_ignores_value) {
+    EXPECT_EQ((BPTree<int, int>::internal_capacity()), (BPTree<int, BigOne>::internal_capacity()));
+    EXPECT_EQ((BPTree<int, int>::internal_capacity()), (BPTree<int, std::string>::internal_capacity()));
+    EXPECT_GT((BPTree<int, int>::leaf_capacity()), (BPTree<int, BigOne>::leaf_capacity()));
+}
+
+TEST(BPTreeBasicTest, packed_separators_raise_fanout) {
+    // a packed separator takes an offset and a few characters instead of a whole std::string
+    EXPECT_GT((BPTree<std::string, int>::internal_capacity()), 4096 / (sizeof(std::string) + sizeof(void *)));
+    EXPECT_EQ(4096, (BPTree<std::string, int>::internal_node_size()));
+    EXPECT_EQ(4096, (BPTree<std::wstring, int>::internal_node_size()));
+}
+
 TEST(BPTreeBasicTest, copy_construct) {
     using Tree    = BPTree<int, std::string>;
     auto first    = std::make_unique<Tree>();
@@ -221,6 +248,419 @@ TEST(BPTreeBasicTest, move_assign) {
     }
 }
 
+TEST(BPTreeBasicTest, emplace_move_only) {
+    BPTree<int, std::unique_ptr<int>> tree;
+    for (int i = 0; i < 3000; ++i) {
+        EXPECT_TRUE(tree.try_emplace(i, std::make_unique<int>(i)).second);
+    }
+    auto ptr = std::make_unique<int>(-1);
+    EXPECT_FALSE(tree.try_emplace(5, std::move(ptr)).second);
+    EXPECT_NE(nullptr, ptr);
+    EXPECT_FALSE(tree.insert_or_assign(5, std::move(ptr)).second);
+    EXPECT_EQ(-1, *tree.at(5));
+    EXPECT_EQ(nullptr, tree[3000]);
+    for (int i = 0; i < 3000; ++i) {
+        EXPECT_EQ(i == 5 ? -1 : i, *tree.at(i));
+    }
+}
+
+TEST(BPTreeBasicTest, hinted_insert) {
+    using Tree = BPTree<int, int, 256>;
+    Tree tree;
+    std::map<int, int> expected;
+    for (int i = 0; i < 20000; i += 2) {
+        const auto it = tree.insert(tree.end(), {i, i});
+        EXPECT_EQ(i, it->first);
+        expected[i] = i;
+    }
+    for (int i = 1; i < 20000; i += 4) {
+        const auto it = tree.insert(tree.lower_bound(i), {i, -i});
+        EXPECT_EQ(-i, it->second);
+        expected[i] = -i;
+    }
+    for (int i = 0; i < 20000; i += 3) {
+        EXPECT_EQ(i, tree.insert(tree.begin(), {i, i})->second);
+        expected[i] = i;
+    }
+    EXPECT_EQ(2, tree.emplace_hint(tree.find(7), 7, 2)->second);
+    EXPECT_EQ(-5, tree.emplace_hint(tree.end(), 5, 2)->second);
+    expected[7] = 2;
+    for (int i = 0; i < 20000; i += 5) {
+        tree.erase(i);
+        expected.erase(i);
+    }
+    for (int i = 20000; i < 30000; ++i) {
+        tree.insert(tree.end(), {i, i});
+        expected[i] = i;
+    }
+    for (int i = 30000; i < 40000; i += 2) {
+        tree.insert(i, i);
+        tree.insert(tree.lower_bound(i - 1), {i - 1, i});
+        expected[i]     = i;
+        expected[i - 1] = i;
+    }
+    EXPECT_EQ(expected.size(), tree.size());
+    const std::vector<std::pair<int, int>> values(expected.begin(), expected.end());
+    EXPECT_TRUE(std::equal(values.begin(), values.end(), tree.begin(), tree.end()));
+}
+
+TEST(BPTreeBasicTest, bulk_load_sorted) {
+    using Tree = BPTree<int, std::string, 256>;
+    for (const double fill_factor : {1.0, 0.7, 0.01}) {
+        for (const int max : {0, 1, 7, 8, 9, 1000, 23456}) {
+            std::vector<std::pair<int, std::string>> data;
+            for (int i = 0; i < max; ++i) {
+                data.emplace_back(2 * i, std::to_string(i));
+            }
+            Tree tree = Tree::from_sorted(data.begin(), data.end(), fill_factor);
+            EXPECT_EQ(data.size(), tree.size());
+            EXPECT_TRUE(std::equal(data.begin(), data.end(), tree.begin(), tree.end()));
+            for (int i = 0; i < max; ++i) {
+                EXPECT_EQ(std::to_string(i), tree.at(2 * i));
+                EXPECT_FALSE(tree.contains(2 * i + 1));
+            }
+            for (int i = 0; i < max; i += 2) {
+                tree.erase(2 * i);
+                tree.insert(2 * i + 1, "odd");
+            }
+            for (int i = 0; i < max; ++i) {
+                EXPECT_EQ(i % 2 == 1, tree.contains(2 * i));
+                EXPECT_EQ(i % 2 == 0, tree.contains(2 * i + 1));
+            }
+        }
+    }
+    std::vector<std::pair<int, std::string>> data = {{1, "a"}};
+    EXPECT_THROW(Tree::from_sorted(data.begin(), data.end(), 0.0), std::invalid_argument);
+    EXPECT_THROW(Tree::from_sorted(data.begin(), data.end(), 1.5), std::invalid_argument);
+}
+
+TEST(BPTreeBasicTest, bulk_load_from_map) {
+    std::map<int, int> source;
+    for (int i = 0; i < 5000; ++i) {
+        source[i * 7 % 5003] = i;
+    }
+    BPTree<int, int> tree;
+    tree.insert(source.begin(), source.end());
+    EXPECT_EQ(source.size(), tree.size());
+    const std::vector<std::pair<int, int>> expected(source.begin(), source.end());
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), tree.begin(), tree.end()));
+}
+
+TEST(BPTreeBasicTest, order_statistics) {
+    using Tree = BPTree<int, int, 256, std::less<int>, bptree::DefaultSearch<int, std::less<int>>, bptree::Arena, true>;
+    EXPECT_EQ(256, Tree::internal_node_size());
+    Tree tree;
+    std::map<int, int> expected;
+    for (int i = 0; i < 30000; ++i) {
+        const int key = static_cast<int>(rgen() % 20000);
+        if (rgen() % 3 == 0) {
+            tree.erase(key);
+            expected.erase(key);
+        } else {
+            tree.insert(key, i);
+            expected[key] = i;
+        }
+        if (i % 5000 == 0) {
+            tree.erase(tree.lower_bound(key), tree.lower_bound(key + 700));
+            expected.erase(expected.lower_bound(key), expected.lower_bound(key + 700));
+        }
+    }
+    ASSERT_EQ(expected.size(), tree.size());
+    for (int key = -1; key <= 20000; key += 37) {
+        const auto bound = expected.lower_bound(key);
+        const auto rank  = static_cast<std::size_t>(std::distance(expected.begin(), bound));
+        EXPECT_EQ(rank, tree.rank(key));
+        const auto it = tree.select(rank);
+        ASSERT_EQ(bound == expected.end(), it == tree.end());
+        if (bound != expected.end()) {
+            EXPECT_EQ(bound->first, it->first);
+        }
+        const auto upper = expected.lower_bound(key + 1000);
+        EXPECT_EQ(static_cast<std::size_t>(std::distance(bound, upper)), tree.count_range(key, key + 1000));
+        EXPECT_EQ(std::distance(bound, upper), tree.distance(tree.lower_bound(key), tree.lower_bound(key + 1000)));
+        EXPECT_EQ(-std::distance(bound, upper), tree.distance(tree.lower_bound(key + 1000), tree.lower_bound(key)));
+    }
+    EXPECT_EQ(0, tree.count_range(10, 10));
+    EXPECT_EQ(tree.end(), tree.select(tree.size()));
+    EXPECT_EQ(static_cast<std::ptrdiff_t>(tree.size()), tree.distance(tree.begin(), tree.end()));
+}
+
+namespace {
+
+// the digits of the values in key order, to check that the aggregates are combined in order
+struct Digits {
+    using type = std::string;
+    static std::string identity() { return {}; }
+    static std::string lift(const int value) { return std::to_string(value % 10); }
+    static std::string combine(const std::string& first, const std::string& second) { return first + second; }
+};
+
+template <class Aggregate>
+using AggregatedTree =
+    BPTree<int, int, 256, std::less<int>, bptree::DefaultSearch<int, std::less<int>>, bptree::Arena, false, Aggregate>;
+
+template <class Aggregate, class Tree>
+void check_aggregates(const Tree& tree, const std::map<int, int>& expected) {
+    for (int lo = -5; lo <= 10000; lo += 91) {
+        for (const int hi : {lo - 1, lo + 1, lo + 50, lo + 3000}) {
+            typename Aggregate::type folded = Aggregate::identity();
+            for (auto it = expected.lower_bound(lo); it != expected.end() && it->first < hi; ++it) {
+                folded = Aggregate::combine(folded, Aggregate::lift(it->second));
+            }
+            EXPECT_EQ(folded, tree.aggregate(lo, hi));
+        }
+    }
+}
+
+template <class Aggregate>
+void test_aggregates() {
+    AggregatedTree<Aggregate> tree;
+    std::map<int, int> expected;
+    EXPECT_EQ(Aggregate::identity(), tree.aggregate(0, 100));
+    for (int i = 0; i < 20000; ++i) {
+        const int key   = static_cast<int>(rgen() % 10000);
+        const int value = static_cast<int>(rgen() % 1000) - 500;
+        if (rgen() % 3 == 0) {
+            tree.erase(key);
+            expected.erase(key);
+        } else {
+            tree.insert(key, value);
+            expected[key] = value;
+        }
+        if (i % 4000 == 0) {
+            tree.erase(tree.lower_bound(key), tree.lower_bound(key + 500));
+            expected.erase(expected.lower_bound(key), expected.lower_bound(key + 500));
+        }
+    }
+    check_aggregates<Aggregate>(tree, expected);
+    const std::vector<std::pair<int, int>> data(expected.begin(), expected.end());
+    check_aggregates<Aggregate>(AggregatedTree<Aggregate>::from_sorted(data.begin(), data.end(), 0.6), expected);
+}
+
+}  // anonymous namespace
+
+TEST(BPTreeBasicTest, range_aggregates) {
+    test_aggregates<bptree::Sum<long long>>();
+    test_aggregates<bptree::Min<int>>();
+    test_aggregates<bptree::Max<int>>();
+    test_aggregates<Digits>();
+}
+
+TEST(BPTreeBasicTest, aggregates_follow_writes) {
+    using Tree = AggregatedTree<bptree::Sum<long long>>;
+    static_assert(std::is_const_v<std::remove_reference_t<decltype((std::declval<Tree&>().begin()->second))>>);
+    static_assert(std::is_const_v<std::remove_reference_t<decltype(std::declval<Tree&>().at(0))>>);
+    Tree tree;
+    std::map<int, int> expected;
+    for (int i = 0; i < 20000; ++i) {
+        const int key   = static_cast<int>(rgen() % 5000);
+        const int value = static_cast<int>(rgen() % 1000) - 500;
+        tree[key]       = value;
+        expected[key]   = value;
+        if (i % 100 == 0) {
+            tree[key + 1]     = tree[key];
+            expected[key + 1] = expected[key];
+        }
+    }
+    EXPECT_EQ(expected.at(7), tree[7]);
+    check_aggregates<bptree::Sum<long long>>(tree, expected);
+}
+
+TEST(BPTreeBasicTest, insert_batch_keeps_summaries) {
+    using Tree = BPTree<int, int, 256, std::less<int>, bptree::DefaultSearch<int, std::less<int>>, bptree::Arena, true,
+                        bptree::Sum<long long>>;
+    Tree tree;
+    std::map<int, int> expected;
+    std::vector<std::pair<int, int>> batch;
+    for (int round = 0; round < 8; ++round) {
+        batch.clear();
+        for (int i = 0; i < 3000; ++i) {
+            batch.emplace_back(static_cast<int>(rgen() % 20000), i - 1500);
+            expected[batch.back().first] = batch.back().second;
+        }
+        tree.insert_batch(batch);
+        tree.erase(tree.lower_bound(round * 2000), tree.lower_bound(round * 2000 + 300));
+        expected.erase(expected.lower_bound(round * 2000), expected.lower_bound(round * 2000 + 300));
+    }
+    ASSERT_EQ(expected.size(), tree.size());
+    for (int key = -1; key <= 20000; key += 37) {
+        const auto bound = expected.lower_bound(key);
+        EXPECT_EQ(static_cast<std::size_t>(std::distance(expected.begin(), bound)), tree.rank(key));
+        long long sum = 0;
+        for (auto it = bound; it != expected.end() && it->first < key + 500; ++it) {
+            sum += it->second;
+        }
+        EXPECT_EQ(sum, tree.aggregate(key, key + 500));
+    }
+}
+
+namespace {
+
+// records are ordered by id alone, so an id is enough to look one up
+struct Record {
+    int id;
+    std::string name;
+};
+
+struct ById {
+    using is_transparent = void;
+
+    bool operator()(const Record& lhs, const Record& rhs) const { return lhs.id < rhs.id; }
+    bool operator()(const Record& lhs, const int rhs) const { return lhs.id < rhs; }
+    bool operator()(const int lhs, const Record& rhs) const { return lhs < rhs.id; }
+};
+
+}  // anonymous namespace
+
+TEST(BPTreeBasicTest, transparent_lookup) {
+    BPTree<std::string, int, 256, std::less<>> tree;
+    std::map<std::string, int, std::less<>> expected;
+    for (int i = 0; i < 5000; ++i) {
+        const std::string key = std::to_string(rgen() % 10000);
+        tree[key]             = i;
+        expected[key]         = i;
+    }
+    const auto same = [&](const auto& it, const auto& expected_it) {
+        if (it == tree.end() || expected_it == expected.end()) {
+            return (it == tree.end()) == (expected_it == expected.end());
+        }
+        return it->first == expected_it->first;
+    };
+    for (int i = 0; i < 10000; i += 7) {
+        const std::string key       = std::to_string(i);
+        const std::string_view view = key;
+        EXPECT_EQ(expected.count(view), tree.count(view));
+        EXPECT_EQ(expected.count(view) != 0, tree.contains(view));
+        EXPECT_TRUE(same(tree.find(view), expected.find(view)));
+        EXPECT_TRUE(same(tree.lower_bound(view), expected.lower_bound(view)));
+        EXPECT_TRUE(same(tree.upper_bound(view), expected.upper_bound(view)));
+        const auto [from, to] = tree.equal_range(view);
+        EXPECT_EQ(static_cast<std::ptrdiff_t>(expected.count(view)), std::distance(from, to));
+    }
+    EXPECT_EQ(expected.count("42") != 0, tree.contains("42"));
+    EXPECT_EQ(tree.find(std::string("42")), tree.find("42"));
+
+    BPTree<Record, std::string, 256, ById> records;
+    for (int i = 0; i < 1000; ++i) {
+        records[Record{2 * i, "record " + std::to_string(i)}] = std::to_string(i);
+    }
+    const auto& const_records = records;
+    EXPECT_EQ("21", records.find(42)->second);
+    EXPECT_EQ("record 21", const_records.find(42)->first.name);
+    EXPECT_EQ(records.end(), records.find(43));
+    EXPECT_EQ(1, records.count(0));
+    EXPECT_FALSE(const_records.contains(-1));
+    EXPECT_EQ(44, records.upper_bound(42)->first.id);
+    EXPECT_EQ(44, const_records.lower_bound(43)->first.id);
+    EXPECT_EQ(const_records.end(), const_records.upper_bound(1998));
+    EXPECT_EQ(1, std::distance(records.equal_range(42).first, records.equal_range(42).second));
+    EXPECT_EQ(0, std::distance(const_records.equal_range(43).first, const_records.equal_range(43).second));
+}
+
+TEST(BPTreeBasicTest, truncated_string_separators) {
+    using Tree = BPTree<std::string, int, 256>;
+    Tree tree;
+    std::map<std::string, int> expected;
+    const auto make_key = [] {
+        std::string key = "shard/" + std::to_string(rgen() % 4) + "/";
+        for (std::size_t length = rgen() % 12; length > 0; --length) {
+            key += static_cast<char>('a' + rgen() % 3);
+        }
+        return key;
+    };
+    std::vector<std::pair<std::string, int>> batch;
+    for (int i = 0; i < 20000; ++i) {
+        const std::string key = make_key();
+        if (i % 7 == 0) {
+            tree.erase(key);
+            expected.erase(key);
+        } else if (i % 5 == 0) {
+            batch.emplace_back(key, i);
+        } else {
+            tree[key]     = i;
+            expected[key] = i;
+        }
+        if (i % 3000 == 0) {
+            tree.insert_batch(batch);
+            for (const auto &[batch_key, value] : batch) {
+                expected[batch_key] = value;
+            }
+            batch.clear();
+            const std::string lo = make_key(), hi = make_key();
+            if (lo < hi) {
+                tree.erase(tree.lower_bound(lo), tree.lower_bound(hi));
+                expected.erase(expected.lower_bound(lo), expected.lower_bound(hi));
+            }
+        }
+    }
+    const std::vector<std::pair<std::string, int>> data(expected.begin(), expected.end());
+    ASSERT_EQ(expected.size(), tree.size());
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), tree.begin(), tree.end()));
+    const Tree loaded                      = Tree::from_sorted(data.begin(), data.end(), 0.8);
+    const std::array<const Tree *, 2> trees = {&tree, &loaded};
+    // separators are prefixes of the keys, so every prefix of a key is looked up as well
+    for (const auto &[key, value] : data) {
+        for (std::size_t length = 0; length <= key.size() + 1; ++length) {
+            const std::string probe = length <= key.size() ? key.substr(0, length) : key + 'a';
+            const auto bound        = expected.lower_bound(probe);
+            for (const Tree *source : trees) {
+                const auto found = source->lower_bound(probe);
+                ASSERT_EQ(bound == expected.end(), found == source->end());
+                if (bound != expected.end()) {
+                    EXPECT_EQ(bound->first, found->first);
+                }
+                EXPECT_EQ(expected.count(probe), source->count(probe));
+            }
+        }
+    }
+}
+
+TEST(BPTreeBasicTest, long_separators_and_shared_prefixes) {
+    using Tree = BPTree<std::string, int, 256>;
+    Tree tree;
+    std::map<std::string, int> expected;
+    // runs of a letter give separators longer than an internal node holds inline, and runs of other lengths keep
+    // cutting the prefix the separators of a node share
+    const auto make_key = [] {
+        return std::string(rgen() % 400, 'a') + static_cast<char>('b' + rgen() % 3) + std::to_string(rgen() % 40);
+    };
+    const auto check_contents = [&expected](const Tree &source) {
+        const std::vector<std::pair<std::string, int>> data(expected.begin(), expected.end());
+        ASSERT_EQ(expected.size(), source.size());
+        EXPECT_TRUE(std::equal(data.begin(), data.end(), source.begin(), source.end()));
+        for (const auto &[key, value] : expected) {
+            const auto found = source.find(key);
+            ASSERT_NE(source.end(), found);
+            EXPECT_EQ(value, found->second);
+            EXPECT_EQ(expected.upper_bound(key) == expected.end(), source.upper_bound(key) == source.end());
+        }
+    };
+    for (int i = 0; i < 6000; ++i) {
+        const std::string key = make_key();
+        if (i % 3 == 0) {
+            EXPECT_EQ(expected.erase(key), tree.erase(key));
+        } else {
+            tree[key]     = i;
+            expected[key] = i;
+        }
+    }
+    check_contents(tree);
+    const Tree copy(tree);
+    check_contents(copy);
+    std::vector<std::pair<std::string, int>> data(expected.begin(), expected.end());
+    std::shuffle(data.begin(), data.end(), rgen);
+    check_contents(Tree::from_unsorted(data, 2, 0.9));
+    Tree batched;
+    batched.insert_batch(data);
+    check_contents(batched);
+    while (expected.size() > 10) {
+        const std::string key = expected.begin()->first;
+        expected.erase(key);
+        tree.erase(key);
+    }
+    check_contents(tree);
+}
+
 TYPED_TEST(BPTreeTest, count) {
     this->insert(TypeParam::create(7));
     EXPECT_EQ(0, this->const_tree().count(TypeParam::create_key(6)));
@@ -257,6 +697,11 @@ TYPED_TEST(BPTreeTest, equal_range) {
         ++from;
         EXPECT_TRUE(from == to);
     }
+    {
+        const auto [from, to] = this->tree.equal_range(TypeParam::create_key(3));
+        EXPECT_TRUE(from == to);
+        EXPECT_EQ(4, TypeParam::key(*from));
+    }
 }
 
 TYPED_TEST(BPTreeTest, at) {
@@ -303,6 +748,32 @@ TYPED_TEST(BPTreeTest, insert) {
     EXPECT_FALSE(this->tree.insert(TypeParam::create_key(13), TypeParam::create_value(13)).second);
 }
 
+TYPED_TEST(BPTreeTest, emplace) {
+    const int max = 5003;
+    for (int i = 0; i < max; ++i) {
+        const int x  = i * 37 % max;
+        const auto r = i % 2 == 0 ? this->tree.try_emplace(TypeParam::create_key(x), TypeParam::create_value(x))
+                                  : this->tree.emplace(TypeParam::create_key(x), TypeParam::create_value(x));
+        EXPECT_TRUE(r.second);
+        EXPECT_EQ(x, TypeParam::key(r.first->first));
+        EXPECT_EQ(x, TypeParam::value(r.first->second));
+    }
+    EXPECT_EQ(max, this->tree.size());
+    const auto kept = this->tree.try_emplace(TypeParam::create_key(7), TypeParam::create_value(1));
+    EXPECT_FALSE(kept.second);
+    EXPECT_EQ(7, TypeParam::value(kept.first->second));
+    EXPECT_FALSE(this->tree.emplace(TypeParam::create(8)).second);
+    EXPECT_EQ(8, TypeParam::value(this->tree.at(TypeParam::create_key(8))));
+    const auto assigned = this->tree.insert_or_assign(TypeParam::create_key(9), TypeParam::create_value(2));
+    EXPECT_FALSE(assigned.second);
+    EXPECT_EQ(2, TypeParam::value(assigned.first->second));
+    const auto added = this->tree.insert_or_assign(TypeParam::create_key(max), TypeParam::create_value(max));
+    EXPECT_TRUE(added.second);
+    EXPECT_EQ(added.first, this->tree.find(TypeParam::create_key(max)));
+    EXPECT_TRUE(TypeParam::empty_value(this->tree[TypeParam::create_key(-1)]));
+    EXPECT_EQ(max + 2, this->tree.size());
+}
+
 TYPED_TEST(BPTreeTest, erase_by_iterator) {
     this->insert(TypeParam::create(11));
     this->insert(TypeParam::create(12));
@@ -330,6 +801,140 @@ TYPED_TEST(BPTreeTest, erase_range) {
     EXPECT_EQ(expected, it) << "expected iterator next to [51, 91)";
 }
 
+TYPED_TEST(BPTreeTest, erase_range_bulk) {
+    const int max = 12007;
+    std::map<int, int> expected;
+    for (int i = 0; i < max; ++i) {
+        this->insert(TypeParam::create(i));
+        expected[i] = i;
+    }
+    const auto erase = [&](const int from, const int to) {
+        const auto& tree  = this->const_tree();
+        const auto start  = from < 0 ? tree.begin() : tree.lower_bound(TypeParam::create_key(from));
+        const auto finish = to < 0 ? tree.end() : tree.lower_bound(TypeParam::create_key(to));
+        const bool to_end = finish == tree.end();
+        const auto it     = this->tree.erase(start, finish);
+        expected.erase(from < 0 ? expected.begin() : expected.lower_bound(from),
+                       to < 0 ? expected.end() : expected.lower_bound(to));
+        EXPECT_EQ(to_end ? this->tree.end() : this->tree.lower_bound(TypeParam::create_key(to)), it);
+        EXPECT_EQ(expected.size(), this->tree.size());
+    };
+    erase(3000, 9000);
+    erase(100, 101);
+    erase(9500, -1);
+    erase(-1, 50);
+    erase(2000, 2000);
+    for (int i = 0; i < max; i += 7) {
+        this->insert(TypeParam::create(i));
+        expected[i] = i;
+    }
+    erase(1000, 10000);
+    auto expected_it = expected.begin();
+    for (const auto& [key, value] : this->tree) {
+        EXPECT_EQ(expected_it->first, TypeParam::key(key));
+        ++expected_it;
+    }
+    EXPECT_EQ(expected.end(), expected_it);
+    erase(-1, -1);
+    EXPECT_TRUE(this->tree.empty());
+    EXPECT_EQ(this->tree.begin(), this->tree.end());
+}
+
+TEST(BPTreeBasicTest, erase_range_of_string_keys) {
+    using Tree = BPTree<std::string, int, 256>;
+    Tree source;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 300; ++i) {
+        keys.push_back("key " + std::to_string(1000 + i));
+        source[keys.back()] = i;
+    }
+    // every key in turn ends a short range, so some of the ranges end right at the first slot of a leaf
+    for (std::size_t last = 2; last < keys.size(); ++last) {
+        Tree tree(source);
+        tree.erase(tree.find(keys[last - 2]), tree.find(keys[last]));
+        ASSERT_EQ(keys.size() - 2, tree.size());
+        std::size_t i = 0;
+        for (const auto& [key, value] : tree) {
+            if (i == last - 2) {
+                i = last;
+            }
+            ASSERT_EQ(keys[i], key) << "after erasing [" << keys[last - 2] << ", " << keys[last] << ")";
+            EXPECT_EQ(static_cast<int>(i), value);
+            ++i;
+        }
+    }
+}
+
+TYPED_TEST(BPTreeTest, reverse_iteration) {
+    EXPECT_EQ(this->tree.rbegin(), this->tree.rend());
+    const int max = 7013;
+    for (int i = 0; i < max; ++i) {
+        this->insert(TypeParam::create(i));
+    }
+    int expected = max;
+    for (auto it = this->const_tree().rbegin(); it != this->const_tree().rend(); ++it) {
+        EXPECT_EQ(--expected, TypeParam::key(it->first));
+    }
+    EXPECT_EQ(0, expected);
+    // the last ten entries before 5000
+    auto it = this->tree.lower_bound(TypeParam::create_key(5000));
+    for (int i = 4999; i >= 4990; --i) {
+        EXPECT_EQ(i, TypeParam::key((--it)->first));
+    }
+    auto last = this->tree.end();
+    EXPECT_EQ(this->tree.end(), last--);
+    EXPECT_EQ(max - 1, TypeParam::key(last->first));
+    EXPECT_EQ(max - 2, TypeParam::key((--last)->first));
+    // end() keeps no pointer into the tree, so it steps back after a move and past the keys appended since
+    auto end    = this->tree.end();
+    auto passed = this->tree.lower_bound(TypeParam::create_key(max - 1));
+    typename TestFixture::Tree moved(std::move(this->tree));
+    EXPECT_EQ(moved.end(), ++passed);
+    for (int i = max; i < max + 1000; ++i) {
+        moved.insert(TypeParam::create_key(i), TypeParam::create_value(i));
+    }
+    EXPECT_EQ(max + 999, TypeParam::key((--end)->first));
+    EXPECT_EQ(max + 999, TypeParam::key((--passed)->first));
+}
+
+TYPED_TEST(BPTreeTest, scan) {
+    using value_type = typename TestFixture::Tree::value_type;
+    const auto keys  = [this](const int lo, const int hi) {
+        std::vector<int> result;
+        this->tree.scan(TypeParam::create_key(lo), TypeParam::create_key(hi),
+                        [&result](const value_type& element) { result.push_back(TypeParam::key(element.first)); });
+        return result;
+    };
+    EXPECT_TRUE(keys(0, 100).empty());
+    const int max = 9001;
+    for (int i = 0; i < max; i += 3) {
+        this->insert(TypeParam::create(i));
+    }
+    for (const auto& [lo, hi] : std::vector<std::pair<int, int>>{{0, 9001}, {1, 2}, {7, 8000}, {5000, 5001}, {9, 3}}) {
+        std::vector<int> expected;
+        for (int i = lo; i < hi; ++i) {
+            if (i % 3 == 0) {
+                expected.push_back(i);
+            }
+        }
+        EXPECT_EQ(expected, keys(lo, hi)) << "[" << lo << ", " << hi << ")";
+    }
+    std::size_t chunks = 0, total = 0;
+    this->tree.scan_chunks(TypeParam::create_key(0), TypeParam::create_key(max),
+                           [&](const value_type* first, const value_type* last) {
+                               EXPECT_LT(first, last);
+                               ++chunks;
+                               total += last - first;
+                           });
+    EXPECT_EQ(this->tree.size(), total);
+    EXPECT_LT(chunks, total);
+    int visited = 0;
+    this->tree.scan(TypeParam::create_key(0), TypeParam::create_key(max), [&visited](const value_type&) {
+        return ++visited < 10;
+    });
+    EXPECT_EQ(10, visited);
+}
+
 TYPED_TEST(BPTreeTest, erase_key) {
     this->insert(TypeParam::create(1));
     this->insert(TypeParam::create(3));
@@ -549,5 +1154,132 @@ TYPED_TEST(BPTreeTest, many_unsorted) {
     }
 }
 
+TYPED_TEST(BPTreeTest, bulk_load_unsorted) {
+    const int max = 3001;
+    std::vector<std::pair<typename TypeParam::key_type, typename TypeParam::value_type>> data;
+    for (int i = 0; i < max; ++i) {
+        data.push_back(TypeParam::create(i));
+        data.emplace_back(TypeParam::create_key(i), TypeParam::create_value(-i));
+    }
+    std::shuffle(data.begin(), data.end(), rgen);
+    for (const auto& element : data) {
+        this->insert(element);
+    }
+    typename TestFixture::Tree loaded;
+    loaded.bulk_load(data.begin(), data.end(), 0.5);
+    EXPECT_EQ(max, loaded.size());
+    EXPECT_TRUE(std::equal(this->tree.begin(), this->tree.end(), loaded.begin(), loaded.end()));
+}
+
+TYPED_TEST(BPTreeTest, parallel_build) {
+    using Tree    = typename TestFixture::Tree;
+    const int max = 20011;
+    std::vector<std::pair<typename TypeParam::key_type, typename TypeParam::value_type>> data;
+    for (int i = 0; i < max; ++i) {
+        data.emplace_back(TypeParam::create_key(i % 7919), TypeParam::create_value(i));
+    }
+    std::shuffle(data.begin(), data.end(), rgen);
+    for (const auto& element : data) {
+        this->insert(element);
+    }
+    for (const std::size_t threads : {0, 1, 2, 3, 8, 64}) {
+        const Tree built = Tree::from_unsorted(data, threads, 0.8);
+        EXPECT_EQ(this->tree.size(), built.size());
+        EXPECT_TRUE(std::equal(this->tree.begin(), this->tree.end(), built.begin(), built.end()));
+    }
+    EXPECT_TRUE(Tree::from_unsorted({}, 4).empty());
+    EXPECT_EQ(1, Tree::from_unsorted({TypeParam::create(5)}, 4).size());
+}
+
+TYPED_TEST(BPTreeTest, find_many) {
+    using Key = typename TypeParam::key_type;
+    std::vector<Key> keys;
+    std::vector<bool> found;
+    this->tree.contains_many(keys.begin(), keys.end(), std::back_inserter(found));
+    EXPECT_TRUE(found.empty());
+    for (int i = 0; i < 5; ++i) {
+        keys.push_back(TypeParam::create_key(i));
+    }
+    this->tree.contains_many(keys.begin(), keys.end(), std::back_inserter(found));
+    EXPECT_EQ(std::vector<bool>(5, false), found);
+
+    const int max = 4001;
+    for (int i = 0; i < max; i += 2) {
+        this->insert(TypeParam::create(i));
+    }
+    std::vector<int> sorted(max + 1);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::vector<int> shuffled = sorted;
+    std::shuffle(shuffled.begin(), shuffled.end(), rgen);
+    std::vector<int> sparse;
+    for (int i = -1; i <= max; i += 97) {
+        sparse.push_back(i);
+    }
+    // runs that stay in a leaf, followed by jumps that leave it
+    std::vector<int> clustered;
+    for (int i = 0; i <= max + 20; i += 450) {
+        for (int j = i; j < i + 30; ++j) {
+            clustered.push_back(j);
+        }
+    }
+    for (const std::vector<int>* batch : {&sorted, &shuffled, &sparse, &clustered}) {
+        keys.clear();
+        for (const int x : *batch) {
+            keys.push_back(TypeParam::create_key(x));
+        }
+        if (batch != &shuffled) {
+            std::sort(keys.begin(), keys.end());
+        }
+        found.clear();
+        this->const_tree().contains_many(keys.begin(), keys.end(), std::back_inserter(found));
+        std::vector<typename TestFixture::Tree::const_iterator> iterators;
+        this->const_tree().find_many(keys.begin(), keys.end(), std::back_inserter(iterators));
+        ASSERT_EQ(keys.size(), found.size());
+        ASSERT_EQ(keys.size(), iterators.size());
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            EXPECT_EQ(this->tree.contains(keys[i]), found[i]);
+            EXPECT_TRUE(this->const_tree().find(keys[i]) == iterators[i]);
+        }
+    }
+}
+
+TYPED_TEST(BPTreeTest, insert_batch) {
+    using Key   = typename TypeParam::key_type;
+    using Value = typename TypeParam::value_type;
+    std::vector<std::pair<Key, Value>> batch;
+    this->tree.insert_batch(batch);
+    EXPECT_TRUE(this->tree.empty());
+
+    std::map<Key, Value> expected;
+    const auto same = [](const auto& a, const auto& b) { return a.first == b.first && a.second == b.second; };
+    for (int round = 0; round < 6; ++round) {
+        batch.clear();
+        const int count = round == 0 ? 3 : 2500 * round;
+        for (int i = 0; i < count; ++i) {
+            const int x = round % 3 == 2 ? 20000 + 3 * round * count + i : static_cast<int>(rgen() % 20000);
+            batch.emplace_back(TypeParam::create_key(x), TypeParam::create_value(x + round));
+            expected[batch.back().first] = batch.back().second;
+        }
+        this->tree.insert_batch(batch.begin(), batch.end());
+        ASSERT_EQ(expected.size(), this->tree.size());
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), this->tree.begin(), this->tree.end(), same));
+        EXPECT_TRUE(std::equal(expected.rbegin(), expected.rend(), this->tree.rbegin(), this->tree.rend(), same));
+        for (int i = 0; i < 500; ++i) {
+            const Key key = TypeParam::create_key(static_cast<int>(rgen() % 30000));
+            this->tree.erase(key);
+            expected.erase(key);
+        }
+    }
+    for (int i = 0; i < 30000; i += 3) {
+        this->insert(TypeParam::create(i));
+        expected[TypeParam::create_key(i)] = TypeParam::create_value(i);
+    }
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), this->tree.begin(), this->tree.end(), same));
+    for (const auto& [key, value] : expected) {
+        EXPECT_EQ(1, this->tree.erase(key));
+    }
+    EXPECT_TRUE(this->tree.empty());
+}
+
 using TypesToTest = ::testing::Types<BPTreeTest<Type<std::string, std::string>>>;
 INSTANTIATE_TYPED_TEST_SUITE_P(BPTree, IteratorTest, TypesToTest);
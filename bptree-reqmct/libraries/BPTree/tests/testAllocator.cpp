@@ -0,0 +1,84 @@
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BPTree.hpp"
+#include "BPTreeAllocator.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+template <class Tree>
+void fill_and_check(Tree &tree, const int max) {
+    for (int i = 0; i < max; ++i) {
+        tree.insert(i, std::to_string(i));
+    }
+    for (int i = 0; i < max; i += 2) {
+        tree.erase(i);
+    }
+    EXPECT_EQ(static_cast<std::size_t>(max / 2), tree.size());
+    for (int i = 0; i < max; ++i) {
+        EXPECT_EQ(i % 2 == 1, tree.contains(i));
+    }
+}
+
+}  // anonymous namespace
+
+TEST(ArenaTest, aligned_blocks) {
+    bptree::Arena<4096, 4096> arena;
+    std::set<void *> blocks;
+    for (int i = 0; i < 1000; ++i) {
+        void *block = arena.allocate();
+        EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(block) % 4096);
+        EXPECT_TRUE(blocks.insert(block).second);
+    }
+    bptree::Arena<24, 8> small;
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(small.allocate()) % 8);
+    }
+}
+
+TEST(ArenaTest, reuses_freed_blocks) {
+    bptree::Arena<4096, 4096> arena;
+    std::vector<void *> blocks;
+    for (int i = 0; i < 300; ++i) {
+        blocks.push_back(arena.allocate());
+    }
+    const std::size_t arenas = arena.arena_count();
+    for (void *block : blocks) {
+        arena.deallocate(block);
+    }
+    const std::set<void *> freed(blocks.begin(), blocks.end());
+    for (int i = 0; i < 300; ++i) {
+        EXPECT_EQ(1, freed.count(arena.allocate()));
+    }
+    EXPECT_EQ(arenas, arena.arena_count());
+    arena.release();
+    EXPECT_EQ(0, arena.arena_count());
+}
+
+TEST(ArenaTest, arenas_grow_geometrically) {
+    bptree::Arena<4096, 4096> arena;
+    // 1 + 2 + ... + 128 blocks, then arenas of 1 MiB
+    for (int i = 0; i < 255 + 256 * 9; ++i) {
+        arena.allocate();
+    }
+    EXPECT_EQ(8 + 9, arena.arena_count());
+}
+
+TEST(ArenaTest, tree_allocators) {
+    BPTree<int, std::string, 256, std::less<int>, bptree::DefaultSearch<int, std::less<int>>, bptree::HeapAllocator>
+        heap;
+    fill_and_check(heap, 5000);
+    BPTree<int, std::string, 256> pooled;
+    fill_and_check(pooled, 5000);
+    pooled.clear();
+    EXPECT_TRUE(pooled.empty());
+    fill_and_check(pooled, 3000);
+    auto moved = std::move(pooled);
+    EXPECT_EQ(1500, moved.size());
+    EXPECT_TRUE(moved.contains(2999));
+    EXPECT_TRUE(pooled.empty());
+    fill_and_check(pooled, 1000);
+}
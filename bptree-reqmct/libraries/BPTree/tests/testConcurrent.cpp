@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "BPTreeConcurrent.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+using Tree = ConcurrentBPTree<long long, long long, 256>;
+
+// every value is derived from its key, so a reader can tell a torn or misplaced value
+long long value_of(const long long key) { return key * 7 + 3; }
+
+std::size_t thread_count() { return std::max<std::size_t>(std::thread::hardware_concurrency(), 4); }
+
+}  // anonymous namespace
+
+TEST(ConcurrentBPTreeTest, single_thread) {
+    Tree tree;
+    std::map<long long, long long> expected;
+    std::mt19937_64 gen(31);
+    for (int i = 0; i < 100000; ++i) {
+        const long long key = static_cast<long long>(gen() % 20000);
+        if (gen() % 3 == 0) {
+            EXPECT_EQ(expected.erase(key), tree.erase(key));
+        } else {
+            EXPECT_EQ(expected.count(key) == 0, tree.insert(key, i));
+            expected[key] = i;
+        }
+    }
+    ASSERT_EQ(expected.size(), tree.size());
+    for (long long key = -1; key <= 20000; ++key) {
+        const auto found = tree.find(key);
+        ASSERT_EQ(expected.count(key) == 1, found.has_value());
+        if (found) {
+            EXPECT_EQ(expected[key], *found);
+        }
+    }
+    std::vector<std::pair<long long, long long>> scanned;
+    tree.scan(100, 15000, [&scanned](const Tree::value_type &element) { scanned.push_back(element); });
+    const std::vector<std::pair<long long, long long>> range(expected.lower_bound(100), expected.lower_bound(15000));
+    EXPECT_EQ(range, scanned);
+}
+
+TEST(ConcurrentBPTreeTest, writers_and_readers) {
+    Tree tree;
+    const std::size_t writers = thread_count();
+    const long long per_writer = 50000;
+    std::atomic<bool> done{false};
+    std::atomic<long long> mismatches{0};
+    std::vector<std::thread> threads;
+    for (std::size_t w = 0; w < writers; ++w) {
+        threads.emplace_back([&tree, w, writers, per_writer] {
+            std::vector<long long> keys(per_writer);
+            for (long long i = 0; i < per_writer; ++i) {
+                keys[i] = i * static_cast<long long>(writers) + static_cast<long long>(w);
+            }
+            std::shuffle(keys.begin(), keys.end(), std::mt19937_64(w));
+            for (const long long key : keys) {
+                tree.insert(key, value_of(key));
+            }
+            for (const long long key : keys) {
+                if (key % 3 == 0) {
+                    tree.erase(key);
+                }
+            }
+        });
+    }
+    for (std::size_t r = 0; r < writers; ++r) {
+        threads.emplace_back([&tree, &done, &mismatches, r, writers, per_writer] {
+            std::mt19937_64 gen(100 + r);
+            const long long max = per_writer * static_cast<long long>(writers);
+            while (!done.load()) {
+                const long long key = static_cast<long long>(gen() % max);
+                const auto found    = tree.find(key);
+                if (found && *found != value_of(key)) {
+                    mismatches++;
+                }
+                long long prev = -1;
+                tree.scan(key, key + 500, [&](const Tree::value_type &element) {
+                    if (element.first <= prev || element.second != value_of(element.first)) {
+                        mismatches++;
+                    }
+                    prev = element.first;
+                });
+            }
+        });
+    }
+    for (std::size_t w = 0; w < writers; ++w) {
+        threads[w].join();
+    }
+    done = true;
+    for (std::size_t r = writers; r < threads.size(); ++r) {
+        threads[r].join();
+    }
+    EXPECT_EQ(0, mismatches.load());
+    const long long max = per_writer * static_cast<long long>(writers);
+    std::size_t count   = 0;
+    for (long long key = 0; key < max; ++key) {
+        const auto found = tree.find(key);
+        ASSERT_EQ(key % 3 != 0, found.has_value()) << key;
+        count += found.has_value();
+    }
+    EXPECT_EQ(count, tree.size());
+    std::size_t scanned = 0;
+    long long prev      = -1;
+    tree.scan(0, max, [&](const Tree::value_type &element) {
+        EXPECT_LT(prev, element.first);
+        prev = element.first;
+        scanned++;
+    });
+    EXPECT_EQ(count, scanned);
+}
+
+TEST(ConcurrentBPTreeTest, readers_see_every_stable_key) {
+    // the odd keys are there from the start and never erased; the writers grow each tree from a single root leaf with
+    // even keys around them, so every level splits, the root many times over the rounds, while the readers look for
+    // the odd keys and scan across them
+    const long long stable = 8, stride = 1000, max = stable * stride;
+    const std::size_t writers = thread_count();
+    std::atomic<long long> missing{0};
+    for (int round = 0; round < 200; ++round) {
+        Tree tree;
+        for (long long i = 0; i < stable; ++i) {
+            tree.insert(i * stride + 1, value_of(i * stride + 1));
+        }
+        std::atomic<std::size_t> running{writers};
+        std::vector<std::thread> threads;
+        for (std::size_t w = 0; w < writers; ++w) {
+            threads.emplace_back([&tree, &running, w, writers, max] {
+                for (long long key = 2 * static_cast<long long>(w); key < max;
+                     key += 2 * static_cast<long long>(writers)) {
+                    tree.insert(key, value_of(key));
+                }
+                running--;
+            });
+        }
+        for (std::size_t r = 0; r < writers; ++r) {
+            threads.emplace_back([&tree, &running, &missing, r, stable, stride] {
+                std::mt19937_64 gen(200 + r);
+                while (running.load() > 0) {
+                    const long long i   = static_cast<long long>(gen() % stable);
+                    const long long key = i * stride + 1;
+                    if (tree.find(key) != std::optional<long long>(value_of(key))) {
+                        missing++;
+                    }
+                    long long seen = 0;
+                    tree.scan(key, key + 2 * stride, [&seen, stride](const Tree::value_type &element) {
+                        seen += element.first % stride == 1;
+                    });
+                    missing += seen != std::min<long long>(2, stable - i);
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQ(static_cast<std::size_t>(stable + max / 2), tree.size());
+    }
+    EXPECT_EQ(0, missing.load());
+}
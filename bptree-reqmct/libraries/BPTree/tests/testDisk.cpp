@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "BPTreeDisk.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+using Tree = DiskBPTree<long long, long long, 512>;
+
+struct DiskBPTreeTest: ::testing::Test {
+    std::string path = ::testing::TempDir() + "bptree_disk_test.db";
+
+    void SetUp() override { TearDown(); }
+
+    void TearDown() override {
+        std::remove(path.c_str());
+        std::remove((path + ".wal").c_str());
+    }
+
+    // runs 'work' in a child process that ends without any destructor or flush, as if it crashed; a tree that
+    // 'work' leaves on the heap is never closed
+    template <class Work>
+    static void crash_after(Work work) {
+        const pid_t child = ::fork();
+        ASSERT_GE(child, 0);
+        if (child == 0) {
+            work();
+            ::_exit(0);
+        }
+        int status = 0;
+        ASSERT_EQ(child, ::waitpid(child, &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+    }
+};
+
+}  // anonymous namespace
+
+TEST_F(DiskBPTreeTest, persists_across_reopening) {
+    std::map<long long, long long> expected;
+    std::mt19937_64 gen(23);
+    {
+        Tree tree(path, 8);
+        for (int i = 0; i < 50000; ++i) {
+            const long long key = static_cast<long long>(gen() % 30000);
+            if (gen() % 4 == 0) {
+                EXPECT_EQ(expected.erase(key), tree.erase(key));
+            } else {
+                EXPECT_EQ(expected.count(key) == 0, tree.insert(key, i));
+                expected[key] = i;
+            }
+        }
+        EXPECT_EQ(expected.size(), tree.size());
+        EXPECT_GT(tree.buffer_pool().writes(), 0u);
+    }
+    Tree tree(path, 16);
+    ASSERT_EQ(expected.size(), tree.size());
+    for (long long key = -1; key <= 30000; ++key) {
+        const auto found = tree.find(key);
+        ASSERT_EQ(expected.count(key) == 1, found.has_value());
+        if (found) {
+            EXPECT_EQ(expected[key], *found);
+        }
+    }
+    std::vector<std::pair<long long, long long>> scanned;
+    tree.scan(1000, 20000, [&scanned](const Tree::value_type &element) { scanned.push_back(element); });
+    const std::vector<std::pair<long long, long long>> range(expected.lower_bound(1000), expected.lower_bound(20000));
+    EXPECT_EQ(range, scanned);
+}
+
+TEST_F(DiskBPTreeTest, lookup_reads_at_most_height_pages) {
+    const long long count = 200000;
+    {
+        Tree tree(path, 64);
+        for (long long i = 0; i < count; ++i) {
+            tree.insert(i * 7919 % count, i);
+        }
+        EXPECT_GE(tree.height(), 3u);
+    }
+    Tree tree(path, 4);
+    std::mt19937_64 gen(5);
+    for (int i = 0; i < 1000; ++i) {
+        const std::size_t before = tree.buffer_pool().reads();
+        EXPECT_TRUE(tree.contains(static_cast<long long>(gen() % count)));
+        EXPECT_LE(tree.buffer_pool().reads() - before, tree.height());
+    }
+    EXPECT_THROW(Tree(path, 2), std::invalid_argument);
+    EXPECT_THROW((DiskBPTree<int, int, 512>(path, 16)), std::runtime_error);
+}
+
+TEST_F(DiskBPTreeTest, recovers_from_log_after_crash) {
+    const auto changes = [](auto apply) {
+        std::mt19937_64 gen(29);
+        for (int i = 0; i < 30000; ++i) {
+            apply(static_cast<long long>(gen() % 20000), gen() % 4 == 0, i);
+        }
+    };
+    crash_after([&] {
+        Tree *tree = new Tree(path, 16, bptree::Durability::per_operation());
+        changes([&](const long long key, const bool erase, const int i) {
+            if (erase) {
+                tree->erase(key);
+            } else {
+                tree->insert(key, i);
+            }
+        });
+    });
+    std::map<long long, long long> expected;
+    changes([&](const long long key, const bool erase, const int i) {
+        if (erase) {
+            expected.erase(key);
+        } else {
+            expected[key] = i;
+        }
+    });
+    Tree tree(path, 16, bptree::Durability::per_operation());
+    ASSERT_EQ(expected.size(), tree.size());
+    std::vector<std::pair<long long, long long>> scanned;
+    tree.scan(0, 20000, [&scanned](const Tree::value_type &element) { scanned.push_back(element); });
+    const std::vector<std::pair<long long, long long>> elements(expected.begin(), expected.end());
+    EXPECT_EQ(elements, scanned);
+}
+
+TEST_F(DiskBPTreeTest, group_commit) {
+    Tree tree(path, 1024, bptree::Durability::per_operations(100));
+    const std::size_t syncs = tree.log_syncs();
+    for (long long i = 0; i < 1000; ++i) {
+        tree.insert(i, i);
+    }
+    EXPECT_EQ(syncs + 10, tree.log_syncs());
+    tree.insert(1000, 1000);
+    tree.commit();
+    EXPECT_EQ(syncs + 11, tree.log_syncs());
+}
+
+TEST_F(DiskBPTreeTest, interval_commit_without_further_operations) {
+    crash_after([&] {
+        Tree *tree = new Tree(path, 1024, bptree::Durability::per_interval(std::chrono::milliseconds(20)));
+        for (long long i = 0; i < 500; ++i) {
+            tree->insert(i, -i);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    });
+    Tree tree(path, 1024, bptree::Durability::per_operation());
+    EXPECT_EQ(500u, tree.size());
+    EXPECT_EQ(std::optional<long long>(-499), tree.find(499));
+}
+
+TEST_F(DiskBPTreeTest, loses_only_uncommitted_changes) {
+    crash_after([&] {
+        Tree *tree = new Tree(path, 1024, bptree::Durability::per_operations(1000));
+        for (long long i = 0; i < 1500; ++i) {
+            tree->insert(i, -i);
+        }
+    });
+    {
+        std::ofstream torn(path + ".wal", std::ios::binary | std::ios::app);
+        torn << "a record cut short";
+    }
+    Tree tree(path, 1024, bptree::Durability::per_operation());
+    EXPECT_EQ(1000u, tree.size());
+    EXPECT_EQ(std::optional<long long>(-999), tree.find(999));
+    EXPECT_FALSE(tree.find(1000).has_value());
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "BPTree.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+template <class Left, class Right>
+bool same_elements(const Left &left, const Right &right) {
+    return std::equal(left.begin(), left.end(), right.begin(), right.end(), [](const auto &a, const auto &b) {
+        return a.first == b.first && a.second == b.second;
+    });
+}
+
+// the keys are unique and both hold the same elements, so a bound is right when it is the end in both or points
+// to the same key in both
+template <class Expected, class FrozenIt>
+void check_bound(const Expected &expected, const typename Expected::const_iterator it, const FrozenIt frozen_it,
+                 const FrozenIt frozen_end) {
+    ASSERT_EQ(it == expected.end(), frozen_it == frozen_end);
+    if (it != expected.end()) {
+        EXPECT_EQ(it->first, frozen_it->first);
+    }
+}
+
+template <class Frozen, class Expected, class Key>
+void check_bounds(const Frozen &frozen, const Expected &expected, const Key &key) {
+    check_bound(expected, expected.lower_bound(key), frozen.lower_bound(key), frozen.end());
+    check_bound(expected, expected.upper_bound(key), frozen.upper_bound(key), frozen.end());
+    EXPECT_EQ(expected.count(key), frozen.count(key));
+    if (expected.count(key) != 0) {
+        EXPECT_EQ(expected.at(key), frozen.find(key)->second);
+        EXPECT_EQ(expected.at(key), frozen.at(key));
+    } else {
+        EXPECT_EQ(frozen.end(), frozen.find(key));
+        EXPECT_THROW(frozen.at(key), std::out_of_range);
+    }
+}
+
+}  // anonymous namespace
+
+TEST(FrozenBPTreeTest, matches_the_mutable_tree) {
+    std::mt19937_64 gen(37);
+    for (const int count : {0, 1, 15, 16, 17, 1000, 100000}) {
+        BPTree<int, int> tree;
+        std::map<int, int> expected;
+        for (int i = 0; i < count; ++i) {
+            const int key = static_cast<int>(gen() % (4 * count)) * 2;
+            tree[key]     = i;
+            expected[key] = i;
+        }
+        const auto frozen = tree.freeze<128>();
+        ASSERT_EQ(expected.size(), frozen.size());
+        EXPECT_TRUE(same_elements(expected, frozen));
+        EXPECT_TRUE(std::equal(tree.rbegin(), tree.rend(), frozen.rbegin(), frozen.rend()));
+        for (int i = 0; i < 2000; ++i) {
+            check_bounds(frozen, expected, static_cast<int>(gen() % (8 * count + 4)) - 2);
+        }
+        for (const auto &[key, value] : expected) {
+            check_bounds(frozen, expected, key);
+        }
+    }
+}
+
+TEST(FrozenBPTreeTest, string_keys_and_comparator) {
+    BPTree<std::string, int, 4096, std::greater<std::string>> tree;
+    std::map<std::string, int, std::greater<std::string>> expected;
+    for (int i = 0; i < 5000; ++i) {
+        const std::string key = "key-" + std::to_string(i * 7 % 5003);
+        tree[key]             = i;
+        expected[key]         = i;
+    }
+    const auto frozen = tree.freeze();
+    EXPECT_TRUE(same_elements(expected, frozen));
+    for (int i = 0; i < 6000; ++i) {
+        check_bounds(frozen, expected, "key-" + std::to_string(i));
+    }
+    const auto range = frozen.equal_range("key-7");
+    ASSERT_EQ(1, std::distance(range.first, range.second));
+    EXPECT_EQ(1, range.first->second);
+}
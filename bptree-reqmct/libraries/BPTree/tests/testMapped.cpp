@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BPTree.hpp"
+#include "BPTreeMapped.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+using Tree   = BPTree<long long, int, 512>;
+using Mapped = MappedBPTree<long long, int, 512>;
+using Pairs  = std::vector<std::pair<long long, int>>;
+
+struct MappedBPTreeTest: ::testing::Test {
+    std::string path = ::testing::TempDir() + "bptree_mapped_test.img";
+
+    void SetUp() override { std::remove(path.c_str()); }
+
+    void TearDown() override { std::remove(path.c_str()); }
+};
+
+}  // anonymous namespace
+
+TEST_F(MappedBPTreeTest, serves_the_saved_tree) {
+    std::map<long long, int> expected;
+    Tree tree;
+    std::mt19937_64 gen(31);
+    for (int i = 0; i < 100000; ++i) {
+        const long long key = static_cast<long long>(gen() % 1000000) * 2;
+        tree.insert(key, i);
+        expected[key] = i;
+    }
+    tree.save(path);
+    tree.clear();
+
+    const Mapped mapped(path);
+    ASSERT_EQ(expected.size(), mapped.size());
+    EXPECT_GE(mapped.height(), 3u);
+    Pairs elements;
+    for (const auto &[key, value] : mapped) {
+        elements.emplace_back(key, value);
+    }
+    EXPECT_EQ(Pairs(expected.begin(), expected.end()), elements);
+    Pairs reversed;
+    for (auto it = mapped.end(); it != mapped.begin();) {
+        --it;
+        reversed.emplace_back(it->first, it->second);
+    }
+    EXPECT_EQ(Pairs(expected.rbegin(), expected.rend()), reversed);
+
+    for (int i = 0; i < 20000; ++i) {
+        const long long key = static_cast<long long>(gen() % 2000010) - 5;
+        const auto bound    = expected.lower_bound(key);
+        const auto found    = mapped.lower_bound(key);
+        if (bound == expected.end()) {
+            EXPECT_EQ(mapped.end(), found);
+            continue;
+        }
+        ASSERT_NE(mapped.end(), found);
+        EXPECT_EQ(bound->first, found.key());
+        EXPECT_EQ(bound->second, found.value());
+        EXPECT_EQ(expected.count(key), mapped.count(key));
+        EXPECT_EQ(expected.upper_bound(key) == expected.end(), mapped.upper_bound(key) == mapped.end());
+        if (expected.count(key) != 0) {
+            EXPECT_EQ(expected[key], mapped.at(key));
+        } else {
+            EXPECT_EQ(mapped.end(), mapped.find(key));
+            EXPECT_THROW(mapped.at(key), std::out_of_range);
+        }
+    }
+}
+
+TEST_F(MappedBPTreeTest, small_and_empty_images) {
+    for (const int count : {0, 1, 2, 500}) {
+        Tree tree;
+        for (int i = 0; i < count; ++i) {
+            tree[i] = -i;
+        }
+        tree.save(path);
+        Mapped mapped(path);
+        EXPECT_EQ(static_cast<std::size_t>(count), mapped.size());
+        EXPECT_EQ(static_cast<std::ptrdiff_t>(count), std::distance(mapped.begin(), mapped.end()));
+        EXPECT_EQ(count > 0, mapped.contains(count - 1));
+        EXPECT_FALSE(mapped.contains(count));
+
+        const Mapped moved = std::move(mapped);
+        EXPECT_EQ(static_cast<std::size_t>(count), moved.size());
+        EXPECT_TRUE(mapped.empty());
+    }
+}
+
+TEST_F(MappedBPTreeTest, rejects_other_files) {
+    EXPECT_THROW(Mapped("/nonexistent/bptree.img"), std::system_error);
+    BPTree<long long, long long, 512> tree;
+    tree[1] = 1;
+    tree.save(path);
+    EXPECT_THROW(Mapped{path}, std::runtime_error);
+    EXPECT_NO_THROW((MappedBPTree<long long, long long, 512>(path)));
+}
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BPTree.hpp"
+#include "BPTreeSearch.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::mt19937_64 gen{7771};
+
+template <class T>
+std::vector<T> sorted_sample(const std::size_t size) {
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    std::vector<T> data(size);
+    for (auto &x : data) {
+        x = static_cast<T>(dist(gen));
+    }
+    std::sort(data.begin(), data.end());
+    data.erase(std::unique(data.begin(), data.end()), data.end());
+    return data;
+}
+
+template <class Search, class T>
+void check_against_std(const std::vector<T> &data) {
+    for (int k = -1010; k <= 1010; k += 3) {
+        const T key = static_cast<T>(k);
+        const auto expected_lower =
+            static_cast<std::size_t>(std::lower_bound(data.begin(), data.end(), key) - data.begin());
+        const auto expected_upper =
+            static_cast<std::size_t>(std::upper_bound(data.begin(), data.end(), key) - data.begin());
+        EXPECT_EQ(expected_lower,
+                  Search::template lower_bound<std::less<T>>(data.data(), data.size(), key, bptree::Identity{}))
+            << "lower bound of " << k << " in " << data.size() << " elements";
+        EXPECT_EQ(expected_upper,
+                  Search::template upper_bound<std::less<T>>(data.data(), data.size(), key, bptree::Identity{}))
+            << "upper bound of " << k << " in " << data.size() << " elements";
+    }
+}
+
+template <class T>
+struct SearchPolicyTest: ::testing::Test {};
+
+using KeyTypes = ::testing::Types<int, unsigned, long long, unsigned long, float, double, short>;
+TYPED_TEST_SUITE(SearchPolicyTest, KeyTypes);
+
+}  // anonymous namespace
+
+TYPED_TEST(SearchPolicyTest, agree_with_std) {
+    for (const std::size_t size : {0, 1, 2, 3, 7, 8, 9, 31, 32, 33, 100, 338, 511, 1500}) {
+        const auto data = sorted_sample<TypeParam>(size);
+        check_against_std<bptree::LinearSearch>(data);
+        check_against_std<bptree::BinarySearch>(data);
+        check_against_std<bptree::BranchingSearch>(data);
+        check_against_std<bptree::SimdSearch>(data);
+    }
+}
+
+TEST(SearchPolicyTest, default_policy) {
+    EXPECT_TRUE(
+        (std::is_same_v<bptree::BranchingSearch, bptree::DefaultSearch<std::string, std::less<std::string>>>));
+    EXPECT_TRUE((std::is_same_v<bptree::BinarySearch, bptree::DefaultSearch<int, std::greater<int>>>));
+    EXPECT_EQ(bptree::prefer_simd, (std::is_same_v<bptree::SimdSearch, bptree::DefaultSearch<int, std::less<int>>>));
+    EXPECT_EQ(bptree::prefer_simd,
+              (std::is_same_v<bptree::SimdSearch, bptree::DefaultSearch<double, std::less<double>>>));
+}
+
+TEST(SearchPolicyTest, tree_with_every_policy) {
+    BPTree<int, int, 256, std::less<int>, bptree::LinearSearch> linear;
+    BPTree<int, int, 256, std::less<int>, bptree::BinarySearch> binary;
+    BPTree<int, int, 256, std::less<int>, bptree::SimdSearch> simd;
+    std::vector<int> keys(5000);
+    std::iota(keys.begin(), keys.end(), -2500);
+    std::shuffle(keys.begin(), keys.end(), gen);
+    for (const int x : keys) {
+        linear.insert(2 * x, x);
+        binary.insert(2 * x, x);
+        simd.insert(2 * x, x);
+    }
+    for (int k = -5002; k < 5002; ++k) {
+        const auto l = linear.lower_bound(k);
+        const auto b = binary.lower_bound(k);
+        const auto s = simd.lower_bound(k);
+        ASSERT_EQ(l == linear.end(), b == binary.end());
+        ASSERT_EQ(l == linear.end(), s == simd.end());
+        if (l != linear.end()) {
+            EXPECT_EQ(l->first, b->first);
+            EXPECT_EQ(l->first, s->first);
+        }
+        EXPECT_EQ(linear.contains(k), simd.contains(k));
+        EXPECT_EQ(binary.contains(k), simd.contains(k));
+    }
+}
@@ -323,6 +323,33 @@ TEST_F(BPTree_3, fill_three_levels__backward_sorted__insert_range) {
                                  << ", " << t_end->second << ">";
 }
 
+TEST_F(BPTree_3, insert_batch) {
+    std::vector<int> expected;
+    for (const int count : {1, 2, 40, 7, 300, 1000}) {
+        std::vector<std::pair<K, V>> batch;
+        for (int i = 0; i < count; ++i) {
+            const int x = static_cast<int>(gen() % 5000);
+            batch.emplace_back(create_key(x), create_value(x));
+            expected.push_back(x);
+        }
+        tree.insert_batch(batch.begin(), batch.end());
+        std::sort(expected.begin(), expected.end());
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        ASSERT_EQ(expected.size(), tree.size());
+        const auto [e_end, t_end] =
+            std::mismatch(expected.begin(), expected.end(), tree.begin(), tree.end(), [](const int x, const auto &el) {
+                return 0 == cmp(create_key(x), el.first) && 0 == cmp(create_value(x), el.second);
+            });
+        EXPECT_EQ(expected.end(), e_end) << "difference at " << std::distance(expected.begin(), e_end);
+        EXPECT_EQ(tree.end(), t_end);
+    }
+    shuffle(expected);
+    for (const int x : expected) {
+        EXPECT_EQ(1, tree.erase(create_key(x)));
+    }
+    EXPECT_TRUE(tree.empty());
+}
+
 TEST_F(BPTree_3, copy) {
     std::vector<std::pair<K, V>> contents;
     contents.reserve(27);
@@ -563,6 +590,36 @@ TEST_F(BPTree_3, erase) {
     CHECK
 }
 
+TEST_F(BPTree_3, erase_ranges_of_a_deep_tree) {
+    std::vector<int> expected;
+    for (int i = 0; i < 3000; ++i) {
+        expected.push_back(i);
+        tree[create_key(i)] = create_value(i);
+    }
+    const auto same = [&] {
+        return std::equal(expected.begin(), expected.end(), tree.begin(), tree.end(), [](const int x, const auto &el) {
+            return 0 == cmp(create_key(x), el.first) && 0 == cmp(create_value(x), el.second);
+        });
+    };
+    while (!expected.empty()) {
+        const std::size_t from = gen() % expected.size();
+        const std::size_t to   = std::min(expected.size(), from + gen() % 200);
+        auto first             = tree.find(create_key(expected[from]));
+        auto last              = to == expected.size() ? tree.end() : tree.find(create_key(expected[to]));
+        tree.erase(first, last);
+        expected.erase(expected.begin() + from, expected.begin() + to);
+        if (!expected.empty()) {
+            const std::size_t single = gen() % expected.size();
+            EXPECT_EQ(1, tree.erase(create_key(expected[single])));
+            expected.erase(expected.begin() + single);
+        }
+        ASSERT_EQ(expected.size(), tree.size());
+        ASSERT_TRUE(same());
+    }
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(tree.begin(), tree.end());
+}
+
 TEST_F(BPTree_3_descending, small_range) {
     const int max = 6;
     std::vector<std::pair<K, V>> contents;
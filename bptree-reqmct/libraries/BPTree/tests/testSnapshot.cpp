@@ -0,0 +1,116 @@
+#include <atomic>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BPTreeSnapshot.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+using Tree = SnapshotBPTree<int, std::string, 256>;
+
+template <class Source>
+std::vector<std::pair<int, std::string>> contents(const Source &source) {
+    std::vector<std::pair<int, std::string>> result;
+    source.scan(std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+                [&result](const std::pair<int, std::string> &element) { result.push_back(element); });
+    return result;
+}
+
+std::vector<std::pair<int, std::string>> contents(const std::map<int, std::string> &source) {
+    return {source.begin(), source.end()};
+}
+
+}  // anonymous namespace
+
+TEST(SnapshotBPTreeTest, snapshots_stay_frozen) {
+    Tree tree;
+    std::map<int, std::string> expected;
+    std::vector<std::pair<Tree::Snapshot, std::map<int, std::string>>> versions;
+    std::mt19937_64 gen(17);
+    for (int i = 0; i < 60000; ++i) {
+        const int key = static_cast<int>(gen() % 5000);
+        if (gen() % 5 < 2) {
+            EXPECT_EQ(expected.erase(key), tree.erase(key));
+        } else {
+            EXPECT_EQ(expected.count(key) == 0, tree.insert(key, std::to_string(i)));
+            expected[key] = std::to_string(i);
+        }
+        if (i % 3000 == 0) {
+            versions.emplace_back(tree.snapshot(), expected);
+        }
+        if (i % 10000 == 0 && !versions.empty()) {
+            versions.erase(versions.begin());
+        }
+    }
+    EXPECT_EQ(expected.size(), tree.size());
+    EXPECT_EQ(contents(expected), contents(tree));
+    for (const auto &[snapshot, frozen] : versions) {
+        EXPECT_EQ(frozen.size(), snapshot.size());
+        EXPECT_EQ(contents(frozen), contents(snapshot));
+        for (int key = 0; key < 5000; key += 7) {
+            const std::string *value = snapshot.find(key);
+            ASSERT_EQ(frozen.count(key) == 1, value != nullptr);
+            if (value != nullptr) {
+                EXPECT_EQ(frozen.at(key), *value);
+            }
+        }
+    }
+}
+
+TEST(SnapshotBPTreeTest, copies_share_nodes) {
+    Tree first;
+    for (int i = 0; i < 10000; ++i) {
+        first.insert(i, std::to_string(i));
+    }
+    Tree second = first;
+    for (int i = 0; i < 10000; i += 2) {
+        second.erase(i);
+        first.insert(i, "changed");
+    }
+    EXPECT_EQ(10000u, first.size());
+    EXPECT_EQ(5000u, second.size());
+    for (int i = 0; i < 10000; ++i) {
+        EXPECT_EQ(i % 2 == 0 ? "changed" : std::to_string(i), *first.find(i));
+        EXPECT_EQ(i % 2 == 1, second.contains(i));
+    }
+    second.clear();
+    EXPECT_TRUE(second.empty());
+    EXPECT_EQ(10000u, first.size());
+}
+
+TEST(SnapshotBPTreeTest, scan_during_ingest) {
+    SnapshotBPTree<long long, long long> tree;
+    for (long long i = 0; i < 100000; ++i) {
+        tree.insert(i, i);
+    }
+    const auto snapshot = tree.snapshot();
+    std::atomic<bool> consistent{true};
+    std::thread reader([&snapshot, &consistent] {
+        for (int round = 0; round < 20; ++round) {
+            long long sum = 0, count = 0;
+            snapshot.scan(0, 1000000, [&](const std::pair<long long, long long> &element) {
+                sum += element.second;
+                count++;
+            });
+            if (count != 100000 || sum != 99999LL * 100000 / 2) {
+                consistent = false;
+            }
+        }
+    });
+    for (long long i = 0; i < 200000; ++i) {
+        if (i % 2 == 0) {
+            tree.erase(i / 2);
+        } else {
+            tree.insert(100000 + i, -i);
+        }
+    }
+    reader.join();
+    EXPECT_TRUE(consistent);
+    EXPECT_EQ(100000u, snapshot.size());
+    EXPECT_EQ(100000u, tree.size());
+}